@@ -335,6 +335,38 @@ class AABB {
         }
     }
 
+    //--- REMOVES A COLLIDER PREVIOUSLY ADDED WITH addAABBToHierarchy
+    //--- IT FOLLOWS THE SAME PATH, SO IT'S REMOVED FROM EVERY LEAF CONTAINER IT WAS ADDED TO
+    void removeAABBFromHierarchy(AABB& collider) {
+
+        //--- SINCE I'M THE LAST LEVEL, I REMOVE THE FIRST CHILD WITH THE SAME BOUNDS
+        if(AcceptChildren) {
+            for (auto i=children.begin(); i!=children.end(); ++i) {
+                if((*i).hasSameBounds(collider)) {
+                    children.erase(i);
+                    return;
+                }
+            }
+            return;
+        }
+
+        for(AABB& child : children) {
+            bool collisionX = (child.MinX <= collider.MaxX && child.MaxX >= collider.MinX);
+            if(collisionX) {
+                bool collisionZ = (child.MinZ <= collider.MaxZ && child.MaxZ >= collider.MinZ);
+                if(collisionZ) {
+                    child.removeAABBFromHierarchy(collider);
+                }
+            }
+        }
+    }
+
+    bool hasSameBounds(AABB& other) {
+        return MinX == other.MinX && MaxX == other.MaxX
+            && MinY == other.MinY && MaxY == other.MaxY
+            && MinZ == other.MinZ && MaxZ == other.MaxZ;
+    }
+
     string toString() {
         return "[" + std::to_string(Hash) + "] X: { " + std::to_string(MinX) + "  " + std::to_string(MaxX) + " } Z: { " + std::to_string(MinZ) + "  " + std::to_string(MaxZ) + " } (" + std::to_string(children.size()) + " children)";
     }
@@ -22,25 +22,34 @@ class CsvLoader {
     public:
     vector<vector<string>> read(string path) {
         vector<vector<string>> content;
+        if(!tryRead(path, content)) {
+            std::cout << "Failed to load level data" << std::endl;
+            exit(0);
+        }
+        return content;
+    }
+
+    //--- SAME AS read, BUT A MISSING FILE IS NOT FATAL (USED WHEN RELOADING THE MAP)
+    //--- A FILE READ WHILE IT'S BEING SAVED CAN BE CUT OR HALF EDITED: THE CALLER HAS TO CHECK THE CONTENT
+    bool tryRead(string path, vector<vector<string>>& content) {
         vector<string> row;
         string line, word;
         fstream file (path, ios::in);
-        if(file.is_open()) {
-            while(getline(file, line))
-            {
-                row.clear();
+        if(!file.is_open()) {
+            return false;
+        }
+        content.clear();
+        while(getline(file, line))
+        {
+            row.clear();
 
-                stringstream str(line);
+            stringstream str(line);
 
-                while(getline(str, word, ',')) {
-                    row.push_back(word);
-                }
-                content.push_back(row);
+            while(getline(str, word, ',')) {
+                row.push_back(word);
             }
-        } else {
-            std::cout << "Failed to load level data" << std::endl;
-            exit(0);
+            content.push_back(row);
         }
-        return content;
+        return true;
     }
 };
\ No newline at end of file
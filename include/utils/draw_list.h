@@ -0,0 +1,91 @@
+/*
+DrawList class
+- list of indirect draw commands (see DrawElementsIndirectCommand in mesh_v1.h), grouped in batches:
+  a batch has one command for each mesh of a model at a LOD (e.g. one batch for each LOD of the trees)
+- the commands are built once, when the batches are added: during the frame only their instance counts change
+  (SetInstances), and the whole list is copied in a stream buffer with a single Write
+- Submit draws the commands of a batch from the buffer: the number of indices, the first index and the base vertex
+  are read by the GPU, and a stage that writes the instance counts in the buffer could change the draws without
+  going back to the CPU
+- GL 4.1 has no glMultiDrawElementsIndirect (GL 4.3): each command is a separate glDrawElementsIndirect,
+  and baseInstance must be 0, so the first instance of a batch is still passed to the shader as a uniform
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+
+#include <utils/gl_state.h>
+#include <utils/stream_buffer.h>
+
+class DrawList
+{
+public:
+    DrawList() = default;
+
+    DrawList(const DrawList& copy) = delete;
+    DrawList& operator=(const DrawList&) = delete;
+
+    //////////////////////////////////////////
+    // it adds a batch with the meshes of the model at a LOD, and it returns its index.
+    // The meshes are referenced by the list: the model must not be moved or reloaded after
+    int Add(Model& model, int lod, GLuint instances = 0)
+    {
+        Batch batch = { this->commands.size(), model.meshes.size() };
+        for (Mesh& mesh : model.meshes)
+        {
+            this->commands.push_back(mesh.IndirectCommand(lod, instances));
+            this->meshes.push_back(&mesh);
+        }
+        this->batches.push_back(batch);
+        return (int)this->batches.size() - 1;
+    }
+
+    // number of instances drawn by the commands of a batch (0 skips the batch)
+    void SetInstances(int batch, GLuint instances)
+    {
+        const Batch& range = this->batches[batch];
+        for (size_t i = range.First; i < range.First + range.Count; i++)
+            this->commands[i].InstanceCount = instances;
+    }
+
+    //////////////////////////////////////////
+    // it copies the commands in the stream buffer (GL_DRAW_INDIRECT_BUFFER), once per frame before the first Submit
+    void Write(StreamBuffer& stream)
+    {
+        this->buffer = stream.Buffer();
+        this->offset = stream.Write(this->commands.data(), this->commands.size() * sizeof(DrawElementsIndirectCommand));
+    }
+
+    // size of all the commands, to size the stream buffer
+    size_t Bytes() const
+    {
+        return this->commands.size() * sizeof(DrawElementsIndirectCommand);
+    }
+
+    // rendering of a batch, with the commands of the last Write
+    void Submit(int batch)
+    {
+        const Batch& range = this->batches[batch];
+        if (range.Count == 0 || this->commands[range.First].InstanceCount == 0)
+            return;
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, this->buffer);
+        for (size_t i = range.First; i < range.First + range.Count; i++)
+            this->meshes[i]->DrawIndirect(this->offset + i * sizeof(DrawElementsIndirectCommand));
+    }
+
+private:
+    struct Batch {
+        size_t First;
+        size_t Count;
+    };
+
+    vector<DrawElementsIndirectCommand> commands;
+    // mesh of each command: its VAO, its index type and its dequantization are not part of the command
+    vector<Mesh*> meshes;
+    vector<Batch> batches;
+    GLuint buffer = 0;
+    GLintptr offset = 0;
+};
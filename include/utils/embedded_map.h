@@ -0,0 +1,163 @@
+//--- COMPILE-TIME LEVEL PARSER
+//--- WHEN THE APP IS BUILT WITH EMBEDDED_MAP THE CSV OF THE LEVEL IS INCLUDED AS A STRING LITERAL
+//--- AND PARSED BY THE COMPILER: THE RESULT IS A FIXED-SIZE TILE GRID AND A TABLE OF THE SPECIAL
+//--- OBJECTS (START, CART, HOUSE, BODY, ODOR AND FOOTPRINTS) BAKED INTO THE EXECUTABLE.
+//--- A MALFORMED MAP BREAKS THE BUILD (SEE THE static_assert IN main.cpp) INSTEAD OF THE APP.
+
+#pragma once
+
+//--- SAME SIZE OF THE PLANE: 32x32 CELLS
+#define MAP_MAX_ROWS 32
+#define MAP_MAX_COLUMNS 32
+#define MAP_MAX_SPECIALS 64
+
+enum class MapError { None, TooManyRows, TooManyColumns, UnknownTile, MissingFootprintOrder, TooManySpecials, MissingStart };
+
+//--- A TILE IS THE FIRST CHARACTER OF THE CSV CELL (0 FOR EMPTY CELLS)
+//--- FOOTPRINTS ALSO CARRY THEIR ORDER (F1, F2, ...)
+struct MapTile {
+    char Type;
+    int Order;
+};
+
+//--- SPECIAL OBJECTS ARE STORED IN ROW-MAJOR ORDER, THE SAME ORDER OF THE RUNTIME LOADER
+struct MapSpecial {
+    char Type;
+    int Row;
+    int Column;
+    int Order;
+};
+
+struct EmbeddedMap {
+    MapTile Tiles[MAP_MAX_ROWS][MAP_MAX_COLUMNS];
+    int Rows;
+    MapSpecial Specials[MAP_MAX_SPECIALS];
+    int SpecialsCount;
+    MapError Error;
+    int ErrorRow;
+    int ErrorColumn;
+
+    constexpr bool isValid() const {
+        return Error == MapError::None;
+    }
+};
+
+constexpr bool isMapSeparator(char c) {
+    return c == ',' || c == '\n' || c == '\r' || c == '\0';
+}
+
+constexpr bool isKnownTile(char c) {
+    return c == 'T' || c == 'P' || c == 'S' || c == 'C' || c == 'H' || c == 'O' || c == 'D' || c == 'F';
+}
+
+constexpr EmbeddedMap mapFailure(EmbeddedMap map, MapError error, int row, int column) {
+    map.Error = error;
+    map.ErrorRow = row;
+    map.ErrorColumn = column;
+    return map;
+}
+
+//--- SAME GRAMMAR OF CsvLoader: ROWS SEPARATED BY NEW LINES, CELLS SEPARATED BY COMMAS
+constexpr EmbeddedMap parseEmbeddedMap(const char* csv) {
+    EmbeddedMap map {};
+    bool hasStart = false;
+    int row = 0;
+    int column = 0;
+    bool rowHasContent = false;
+    const char* c = csv;
+
+    //--- THE RAW STRING LITERAL STARTS WITH A NEW LINE
+    while(*c == '\n' || *c == '\r') {
+        c++;
+    }
+
+    while(*c != '\0') {
+        //--- THE RULES OF THE MAKEFILES ADD A NEW LINE AFTER THE FILE, WHICH CAN ALREADY END WITH ONE:
+        //--- THE BLANK LINES AT THE END ARE NOT ROWS (LIKE IN CsvLoader)
+        if(column == 0) {
+            const char* end = c;
+            while(*end == '\n' || *end == '\r') {
+                end++;
+            }
+            if(*end == '\0') {
+                break;
+            }
+        }
+
+        //--- READ ONE CELL
+        char type = 0;
+        int order = 0;
+        bool hasOrder = false;
+        if(!isMapSeparator(*c)) {
+            type = *c;
+            c++;
+            while(*c >= '0' && *c <= '9') {
+                order = order * 10 + (*c - '0');
+                hasOrder = true;
+                c++;
+            }
+            if(!isKnownTile(type) || !isMapSeparator(*c)) {
+                return mapFailure(map, MapError::UnknownTile, row, column);
+            }
+            if(type == 'F' && !hasOrder) {
+                return mapFailure(map, MapError::MissingFootprintOrder, row, column);
+            }
+        }
+
+        if(row >= MAP_MAX_ROWS) {
+            return mapFailure(map, MapError::TooManyRows, row, column);
+        }
+        if(column >= MAP_MAX_COLUMNS) {
+            return mapFailure(map, MapError::TooManyColumns, row, column);
+        }
+
+        map.Tiles[row][column].Type = type;
+        map.Tiles[row][column].Order = order;
+        rowHasContent = true;
+
+        //--- TREES AND PATHS ONLY LIVE IN THE GRID, EVERYTHING ELSE ALSO GOES IN THE TABLE
+        if(type != 0 && type != 'T' && type != 'P') {
+            if(map.SpecialsCount >= MAP_MAX_SPECIALS) {
+                return mapFailure(map, MapError::TooManySpecials, row, column);
+            }
+            map.Specials[map.SpecialsCount].Type = type;
+            map.Specials[map.SpecialsCount].Row = row;
+            map.Specials[map.SpecialsCount].Column = column;
+            map.Specials[map.SpecialsCount].Order = order;
+            map.SpecialsCount++;
+            hasStart = hasStart || type == 'S';
+        }
+
+        //--- MOVE TO THE NEXT CELL OR TO THE NEXT ROW
+        if(*c == ',') {
+            column++;
+            c++;
+        } else {
+            if(*c == '\r') {
+                c++;
+            }
+            if(*c == '\n') {
+                c++;
+            }
+            row++;
+            column = 0;
+            rowHasContent = false;
+        }
+    }
+
+    map.Rows = rowHasContent ? row + 1 : row;
+
+    if(!hasStart) {
+        return mapFailure(map, MapError::MissingStart, row, column);
+    }
+
+    return map;
+}
+
+//--- REGRESSION CASES: A FULL MAP THAT ENDS WITH A NEW LINE (PLUS THE ONE OF THE MAKEFILE RULE) AND A SHORTER ONE
+constexpr const char* MAP_TEST_FULL_ROWS =
+    "\nS\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\nT\n\n";
+static_assert(parseEmbeddedMap(MAP_TEST_FULL_ROWS).isValid() && parseEmbeddedMap(MAP_TEST_FULL_ROWS).Rows == MAP_MAX_ROWS,
+    "a map ending with a new line must not have an extra row");
+static_assert(parseEmbeddedMap("\nS,T\nP,F1\n\n").isValid() && parseEmbeddedMap("\nS,T\nP,F1\n\n").Rows == 2,
+    "a map ending with a new line must not have an extra row");
@@ -0,0 +1,52 @@
+//--- POLLS THE LAST MODIFICATION TIME OF A FILE
+//--- THE CHECK IS A SINGLE stat CALL, DONE AT MOST ONCE EVERY interval SECONDS
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+class FileWatcher {
+    public:
+
+    FileWatcher(string path, double interval) : path(path), interval(interval) {
+        lastModified = modificationTime();
+    }
+
+    //--- RETURNS TRUE ONCE FOR EACH CHANGE OF THE FILE
+    bool changed(double now) {
+        if(now - lastCheck < interval) {
+            return false;
+        }
+        lastCheck = now;
+        long long modified = modificationTime();
+        //--- A MISSING FILE (E.G. WHILE AN EDITOR IS SAVING IT) IS NOT A CHANGE
+        if(modified < 0 || modified == lastModified) {
+            return false;
+        }
+        lastModified = modified;
+        return true;
+    }
+
+    private:
+
+    string path;
+    double interval;
+    double lastCheck = 0.0;
+    long long lastModified = -1;
+
+    long long modificationTime() {
+#ifdef _WIN32
+        struct _stat info;
+        if(_stat(path.c_str(), &info) != 0) {
+            return -1;
+        }
+#else
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0) {
+            return -1;
+        }
+#endif
+        return (long long) info.st_mtime;
+    }
+};
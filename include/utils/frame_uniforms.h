@@ -0,0 +1,41 @@
+//--- PER-FRAME/PER-VIEW CONSTANTS, READ BY ALL THE PROGRAMS FROM THE "Frame" UNIFORM BLOCK
+//--- THE STRUCT MIRRORS THE std140 LAYOUT OF THE BLOCK DECLARED IN THE SHADERS: THE OFFSETS ARE CHECKED AT COMPILE TIME,
+//--- SO A CHANGE OF THE STRUCT THAT DOESN'T MATCH THE RULES OF std140 FAILS THE BUILD INSTEAD OF READING GARBAGE.
+//--- EACH VIEW IS WRITTEN ONCE PER FRAME IN A StreamBuffer, AND ITS RANGE IS BOUND WITH glBindBufferRange BEFORE ITS DRAWS:
+//--- THE PROGRAMS DON'T KEEP ANY COPY OF THE CAMERA, SO THEY CAN'T BE LEFT WITH THE ONE OF A PREVIOUS PASS
+
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+//--- BINDING POINT OF THE BLOCK
+#define FRAME_BLOCK_BINDING 2
+
+struct FrameUniforms {
+    glm::mat4 ProjectionMatrix;
+    glm::mat4 ViewMatrix;
+    //--- xyz: POSITION OF THE CAMERA IN WORLD SPACE (A vec3 TAKES 16 BYTES IN std140 ANYWAY)
+    glm::vec4 CameraPosition;
+    float Time;
+    float Distorsion;
+    //--- std140 ROUNDS THE SIZE OF THE BLOCK TO A MULTIPLE OF 16 BYTES
+    float Padding[2];
+};
+
+//--- std140: A mat4 IS 4 vec4 COLUMNS, vec4 ARE ALIGNED TO 16 BYTES, SCALARS TO 4 BYTES
+static_assert(offsetof(FrameUniforms, ProjectionMatrix) == 0, "Frame block: projectionMatrix must be at offset 0");
+static_assert(offsetof(FrameUniforms, ViewMatrix) == 64, "Frame block: viewMatrix must be at offset 64");
+static_assert(offsetof(FrameUniforms, CameraPosition) == 128, "Frame block: cameraPosition must be at offset 128");
+static_assert(offsetof(FrameUniforms, Time) == 144, "Frame block: time must be at offset 144");
+static_assert(offsetof(FrameUniforms, Distorsion) == 148, "Frame block: distorsion must be at offset 148");
+static_assert(sizeof(FrameUniforms) == 160, "Frame block: the size must be 160 bytes");
+
+//--- CONNECTS THE BLOCK OF A PROGRAM TO ITS BINDING POINT (PROGRAMS THAT DON'T READ THE BLOCK ARE SKIPPED)
+inline void bindFrameBlock(Shader& shader) {
+    GLuint block = shader.UniformBlock("Frame");
+    if(block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.Program, block, FRAME_BLOCK_BINDING);
+    }
+}
@@ -0,0 +1,119 @@
+//--- VIEW FRUSTUM CULLING OF BOUNDING SPHERES
+//--- THE PLANES ARE EXTRACTED FROM THE PROJECTION * VIEW MATRIX (GRIBB/HARTMANN), NORMALIZED AND POINTING INSIDE:
+//--- A SPHERE IS OUTSIDE IF ITS CENTER IS FARTHER THAN ITS RADIUS BEHIND ANY OF THE SIX PLANES.
+//--- THE SPHERES ARE STORED AS SEPARATE ARRAYS OF X, Y, Z AND RADIUS (STRUCTURE OF ARRAYS): WITH SSE FOUR SPHERES ARE
+//--- TESTED AGAINST A PLANE WITH THREE MULTIPLY-ADDS AND A COMPARE, WITHOUT SHUFFLES. WITHOUT SSE THE SAME TEST IS DONE
+//--- ONE SPHERE AT A TIME.
+//--- Cull ONLY READS THE SPHERES AND THE PLANES, SO DIFFERENT RANGES CAN BE CULLED ON DIFFERENT THREADS AT THE SAME TIME
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+struct SphereSet {
+    std::vector<float> X;
+    std::vector<float> Y;
+    std::vector<float> Z;
+    std::vector<float> Radius;
+
+    void Clear() {
+        X.clear();
+        Y.clear();
+        Z.clear();
+        Radius.clear();
+    }
+
+    void Reserve(size_t count) {
+        X.reserve(count);
+        Y.reserve(count);
+        Z.reserve(count);
+        Radius.reserve(count);
+    }
+
+    void Add(glm::vec3 center, float radius) {
+        X.push_back(center.x);
+        Y.push_back(center.y);
+        Z.push_back(center.z);
+        Radius.push_back(radius);
+    }
+
+    size_t Size() const {
+        return X.size();
+    }
+};
+
+class Frustum {
+    public:
+
+    Frustum() = default;
+
+    Frustum(const glm::mat4& viewProjection) {
+        //--- ROWS OF THE MATRIX (GLM IS COLUMN MAJOR)
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+        //--- LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR
+        for(int i = 0; i < 3; i++) {
+            planes[i * 2] = rows[3] + rows[i];
+            planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for(glm::vec4& plane : planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+
+    //--- LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR (E.G. FOR THE CULLING ON THE GPU)
+    const glm::vec4* Planes() const {
+        return planes;
+    }
+
+    //--- visible[i] IS SET TO 1 IF THE SPHERE first + i INTERSECTS THE FRUSTUM, TO 0 OTHERWISE
+    void Cull(const SphereSet& spheres, size_t first, size_t count, uint8_t* visible) const {
+        size_t end = first + count;
+        size_t i = first;
+#ifdef FRUSTUM_SSE
+        for(; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(&spheres.X[i]);
+            __m128 y = _mm_loadu_ps(&spheres.Y[i]);
+            __m128 z = _mm_loadu_ps(&spheres.Z[i]);
+            __m128 minusRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.Radius[i]));
+            __m128 inside = _mm_cmpgt_ps(planeDistance(planes[0], x, y, z), minusRadius);
+            for(int p = 1; p < 6; p++) {
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(planeDistance(planes[p], x, y, z), minusRadius));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for(size_t j = 0; j < 4; j++) {
+                visible[i + j - first] = (mask >> j) & 1;
+            }
+        }
+#endif
+        //--- THE LAST 0-3 SPHERES (OR ALL OF THEM WITHOUT SSE)
+        for(; i < end; i++) {
+            bool inside = true;
+            for(const glm::vec4& plane : planes) {
+                inside = inside && plane.x * spheres.X[i] + plane.y * spheres.Y[i] + plane.z * spheres.Z[i] + plane.w > -spheres.Radius[i];
+            }
+            visible[i - first] = inside ? 1 : 0;
+        }
+    }
+
+    private:
+
+    glm::vec4 planes[6];
+
+#ifdef FRUSTUM_SSE
+    static __m128 planeDistance(const glm::vec4& plane, __m128 x, __m128 y, __m128 z) {
+        __m128 xy = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+        return _mm_add_ps(xy, _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+    }
+#endif
+};
@@ -0,0 +1,134 @@
+/*
+GeometryArena class
+- one large VBO and one large EBO for each vertex layout (see vertex_format.h), shared by all the static meshes
+- a mesh is a suballocation of the two buffers: its vertices start at BaseVertex, its indices at FirstIndexByte,
+  and it is drawn with glDrawElementsBaseVertex, so its indices stay relative to its own vertices
+  (and 16 bit indices can still be used for small meshes, even if the arena holds more than 65536 vertices)
+- there is a single VAO for each arena, so consecutive draws of different meshes don't switch VAO
+  (the bindings go through the shadow of the state, see gl_state.h: a Bind of the VAO already bound is skipped)
+- the buffers grow by doubling their size: the content is copied on the GPU (glCopyBufferSubData) and the VAO is set up again.
+  Suballocations are never released: the arena is meant for the models loaded at startup
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <algorithm>
+
+#include <utils/gl_state.h>
+
+// starting size of the buffers of an arena
+#define ARENA_VERTEX_CAPACITY (1 << 20)
+#define ARENA_INDEX_CAPACITY (1 << 18)
+
+struct ArenaAllocation {
+    GLint BaseVertex;
+    size_t FirstIndexByte;
+};
+
+class GeometryArena {
+public:
+    GeometryArena(const GeometryArena& copy) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    //////////////////////////////////////////
+    // arena of a vertex layout, created with the first mesh of that layout
+    static GeometryArena& Get(VertexLayout layout)
+    {
+        static GeometryArena full(VertexLayout::Full);
+        static GeometryArena compact(VertexLayout::Compact);
+        return layout == VertexLayout::Compact ? compact : full;
+    }
+
+    //////////////////////////////////////////
+    // it copies the vertices (already in the format of the layout) and the indices at the end of the buffers
+    ArenaAllocation Allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexBytes)
+    {
+        const VertexFormat& format = VertexFormat::Get(this->layout);
+        size_t vertexBytes = vertexCount * format.Stride;
+        // 32 bit indices of a mesh must be aligned to 4 bytes, even if the previous mesh has an odd number of 16 bit indices
+        this->indexUsed = (this->indexUsed + 3) & ~(size_t)3;
+
+        bool grown = grow(this->VBO, this->vertexCapacity, this->vertexUsed, this->vertexUsed + vertexBytes, ARENA_VERTEX_CAPACITY);
+        grown = grow(this->EBO, this->indexCapacity, this->indexUsed, this->indexUsed + indexBytes, ARENA_INDEX_CAPACITY) || grown;
+        if (grown)
+            this->setupVAO();
+
+        // the buffers are written through the copy target, so the element buffer of the bound VAO is not touched
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, this->VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, this->vertexUsed, vertexBytes, vertices);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, this->indexUsed, indexBytes, indices);
+
+        ArenaAllocation allocation = { (GLint)(this->vertexUsed / format.Stride), this->indexUsed };
+        this->vertexUsed += vertexBytes;
+        this->indexUsed += indexBytes;
+        return allocation;
+    }
+
+    //////////////////////////////////////////
+    // it binds the VAO of the arena, if it is not already bound
+    void Bind()
+    {
+        GLState::Get().BindVertexArray(this->VAO);
+    }
+
+    GLuint VertexBuffer() const
+    {
+        return this->VBO;
+    }
+
+    GLuint IndexBuffer() const
+    {
+        return this->EBO;
+    }
+
+private:
+    VertexLayout layout;
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    size_t vertexCapacity = 0, vertexUsed = 0;
+    size_t indexCapacity = 0, indexUsed = 0;
+
+    GeometryArena(VertexLayout layout) : layout(layout)
+    {
+        glGenVertexArrays(1, &this->VAO);
+    }
+
+    //////////////////////////////////////////
+    // it makes room for needed bytes, copying the used part in a new buffer. It returns true if the buffer has changed
+    static bool grow(GLuint& buffer, size_t& capacity, size_t used, size_t needed, size_t minimum)
+    {
+        if (needed <= capacity)
+            return false;
+
+        size_t newCapacity = max(max(capacity * 2, needed), minimum);
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+        if (buffer)
+        {
+            if (used)
+            {
+                GLState::Get().BindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            }
+            GLState::Get().DeleteBuffers(1, &buffer);
+        }
+
+        buffer = newBuffer;
+        capacity = newCapacity;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // the pointers of the attributes refer to the VBO bound when they are set, so they are set again when the VBO changes
+    void setupVAO()
+    {
+        GLState::Get().BindVertexArray(this->VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        VertexFormat::Get(this->layout).Setup();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+    }
+};
@@ -0,0 +1,299 @@
+//--- SHADOW OF THE OPENGL STATE CHANGED DURING THE FRAME: PROGRAM, VAO, ACTIVE UNIT AND TEXTURES OF EACH UNIT, BUFFERS,
+//--- STENCIL/DEPTH/COLOR MASKS, STENCIL FUNCTION AND OPERATIONS, ENABLED CAPABILITIES.
+//--- EACH CALL IS COMPARED WITH THE LAST VALUE SET: IF NOTHING WOULD CHANGE IT'S SKIPPED, OTHERWISE IT'S ISSUED TO THE DRIVER.
+//--- THE SHADOW IS RIGHT ONLY IF ALL THE CHANGES OF THAT STATE GO THROUGH HERE: A glBindTexture CALLED DIRECTLY WOULD
+//--- LEAVE A STALE VALUE (Invalidate FORGETS EVERYTHING, E.G. AFTER CODE THAT CAN'T BE CHANGED).
+//--- THE VALUES START AS UNKNOWN, SO THE FIRST CALL IS ALWAYS ISSUED.
+//--- THE BUFFERS ARE SHADOWED ONLY FOR THE TARGETS THAT ARE NOT CHANGED BEHIND ITS BACK: GL_ELEMENT_ARRAY_BUFFER IS PART
+//--- OF THE VAO, GL_UNIFORM_BUFFER AND GL_TRANSFORM_FEEDBACK_BUFFER ARE ALSO SET BY glBindBufferRange/glBindBufferBase.
+//--- THE OTHER TARGETS ARE ALWAYS ISSUED.
+//--- DELETING AN OBJECT UNBINDS IT: THE Delete* CALLS FORGET IT BEFORE DELETING IT, SO A NEW OBJECT WITH THE SAME NAME
+//--- IS BOUND AGAIN
+
+#pragma once
+
+#include <cstdint>
+
+//--- TEXTURE UNITS SHADOWED (THE OTHERS ARE ALWAYS ISSUED)
+#define GL_STATE_TEXTURE_UNITS 32
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+class GLState {
+    public:
+
+    GLState(const GLState& copy) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    //--- THE STATE OF THE CONTEXT (THE APP HAS A SINGLE ONE)
+    static GLState& Get() {
+        static GLState state;
+        return state;
+    }
+
+    void UseProgram(GLuint program) {
+        if(changed(currentProgram, program)) {
+            glUseProgram(program);
+        }
+    }
+
+    void BindVertexArray(GLuint vao) {
+        if(changed(vertexArray, vao)) {
+            glBindVertexArray(vao);
+        }
+    }
+
+    void ActiveTexture(GLenum unit) {
+        if(changed(activeUnit, unit - GL_TEXTURE0)) {
+            glActiveTexture(unit);
+        }
+    }
+
+    //--- ON THE ACTIVE UNIT, LIKE glBindTexture
+    void BindTexture(GLenum target, GLuint texture) {
+        GLuint* shadow = textureShadow(activeUnit, target);
+        if(!shadow) {
+            issue();
+            glBindTexture(target, texture);
+        } else if(changed(*shadow, texture)) {
+            glBindTexture(target, texture);
+        }
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer) {
+        GLuint* shadow = bufferShadow(target);
+        if(!shadow) {
+            issue();
+            glBindBuffer(target, buffer);
+        } else if(changed(*shadow, buffer)) {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    void StencilMask(GLuint mask) {
+        if(changed(stencilMask, mask)) {
+            glStencilMask(mask);
+        }
+    }
+
+    void StencilFunc(GLenum func, GLint ref, GLuint mask) {
+        bool skip = stencilFunc == func && stencilRef == (GLuint)ref && stencilFuncMask == mask;
+        if(count(skip)) {
+            stencilFunc = func;
+            stencilRef = ref;
+            stencilFuncMask = mask;
+            glStencilFunc(func, ref, mask);
+        }
+    }
+
+    void StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass) {
+        bool skip = stencilOps[0] == stencilFail && stencilOps[1] == depthFail && stencilOps[2] == depthPass;
+        if(count(skip)) {
+            stencilOps[0] = stencilFail;
+            stencilOps[1] = depthFail;
+            stencilOps[2] = depthPass;
+            glStencilOp(stencilFail, depthFail, depthPass);
+        }
+    }
+
+    void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+        GLuint mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+        if(changed(colorMask, mask)) {
+            glColorMask(red, green, blue, alpha);
+        }
+    }
+
+    void DepthMask(GLboolean flag) {
+        if(changed(depthMask, flag ? 1 : 0)) {
+            glDepthMask(flag);
+        }
+    }
+
+    void Enable(GLenum capability) {
+        GLuint* shadow = capabilityShadow(capability);
+        if(!shadow) {
+            issue();
+            glEnable(capability);
+        } else if(changed(*shadow, 1)) {
+            glEnable(capability);
+        }
+    }
+
+    void Disable(GLenum capability) {
+        GLuint* shadow = capabilityShadow(capability);
+        if(!shadow) {
+            issue();
+            glDisable(capability);
+        } else if(changed(*shadow, 0)) {
+            glDisable(capability);
+        }
+    }
+
+    //--- THE OBJECTS ARE FORGOTTEN BY THE SHADOW BEFORE BEING DELETED
+    void DeleteProgram(GLuint program) {
+        //--- A PROGRAM IN USE IS DELETED ONLY WHEN ANOTHER ONE IS USED: THE NEXT UseProgram IS ALWAYS ISSUED
+        if(currentProgram == program) {
+            currentProgram = GL_STATE_UNKNOWN;
+        }
+        glDeleteProgram(program);
+    }
+
+    void DeleteVertexArrays(GLsizei n, const GLuint* vaos) {
+        for(GLsizei i = 0; i < n; i++) {
+            forget(&vertexArray, 1, vaos[i]);
+        }
+        glDeleteVertexArrays(n, vaos);
+    }
+
+    void DeleteTextures(GLsizei n, const GLuint* textures) {
+        for(GLsizei i = 0; i < n; i++) {
+            forget(&textures2D[0], GL_STATE_TEXTURE_UNITS, textures[i]);
+            forget(&textures2DArray[0], GL_STATE_TEXTURE_UNITS, textures[i]);
+            forget(&texturesBuffer[0], GL_STATE_TEXTURE_UNITS, textures[i]);
+        }
+        glDeleteTextures(n, textures);
+    }
+
+    void DeleteBuffers(GLsizei n, const GLuint* buffers) {
+        for(GLsizei i = 0; i < n; i++) {
+            forget(&bufferTargets[0], BUFFER_TARGETS, buffers[i]);
+        }
+        glDeleteBuffers(n, buffers);
+    }
+
+    //--- EVERYTHING IS UNKNOWN AGAIN: THE NEXT CALLS ARE ISSUED
+    void Invalidate() {
+        currentProgram = GL_STATE_UNKNOWN;
+        vertexArray = GL_STATE_UNKNOWN;
+        activeUnit = GL_STATE_UNKNOWN;
+        for(int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+            textures2D[i] = GL_STATE_UNKNOWN;
+            textures2DArray[i] = GL_STATE_UNKNOWN;
+            texturesBuffer[i] = GL_STATE_UNKNOWN;
+        }
+        for(GLuint& buffer : bufferTargets) {
+            buffer = GL_STATE_UNKNOWN;
+        }
+        stencilMask = GL_STATE_UNKNOWN;
+        stencilFunc = GL_STATE_UNKNOWN;
+        stencilRef = GL_STATE_UNKNOWN;
+        stencilFuncMask = GL_STATE_UNKNOWN;
+        for(GLuint& op : stencilOps) {
+            op = GL_STATE_UNKNOWN;
+        }
+        colorMask = GL_STATE_UNKNOWN;
+        depthMask = GL_STATE_UNKNOWN;
+        for(GLuint& capability : capabilities) {
+            capability = GL_STATE_UNKNOWN;
+        }
+    }
+
+    //--- CALLS ISSUED TO THE DRIVER AND SKIPPED SINCE THE LAST ResetCounters (E.G. ONCE PER FRAME)
+    uint32_t Issued() const {
+        return issued;
+    }
+
+    uint32_t Skipped() const {
+        return skipped;
+    }
+
+    void ResetCounters() {
+        issued = 0;
+        skipped = 0;
+    }
+
+    private:
+
+    //--- GL_ARRAY_BUFFER, GL_TEXTURE_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_UNPACK_BUFFER
+    static const int BUFFER_TARGETS = 6;
+    //--- GL_DEPTH_TEST, GL_STENCIL_TEST, GL_BLEND, GL_PROGRAM_POINT_SIZE, GL_RASTERIZER_DISCARD
+    static const int CAPABILITIES = 5;
+
+    GLuint currentProgram;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint textures2D[GL_STATE_TEXTURE_UNITS];
+    GLuint textures2DArray[GL_STATE_TEXTURE_UNITS];
+    GLuint texturesBuffer[GL_STATE_TEXTURE_UNITS];
+    GLuint bufferTargets[BUFFER_TARGETS];
+    GLuint stencilMask;
+    GLuint stencilFunc;
+    GLuint stencilRef;
+    GLuint stencilFuncMask;
+    GLuint stencilOps[3];
+    GLuint colorMask;
+    GLuint depthMask;
+    GLuint capabilities[CAPABILITIES];
+    uint32_t issued = 0;
+    uint32_t skipped = 0;
+
+    GLState() {
+        Invalidate();
+    }
+
+    //--- IT RETURNS TRUE (AND COUNTS AN ISSUED CALL) IF THE CALL MUST BE ISSUED
+    bool count(bool skip) {
+        if(skip) {
+            skipped++;
+            return false;
+        }
+        issued++;
+        return true;
+    }
+
+    void issue() {
+        issued++;
+    }
+
+    //--- IT UPDATES THE SHADOW, AND RETURNS TRUE IF THE VALUE HAS CHANGED
+    bool changed(GLuint& shadow, GLuint value) {
+        if(!count(shadow == value)) {
+            return false;
+        }
+        shadow = value;
+        return true;
+    }
+
+    //--- A DELETED OBJECT IS NOT BOUND ANYMORE: ITS SLOTS GO BACK TO 0
+    void forget(GLuint* shadows, int n, GLuint name) {
+        for(int i = 0; i < n; i++) {
+            if(shadows[i] == name) {
+                shadows[i] = 0;
+            }
+        }
+    }
+
+    GLuint* textureShadow(GLuint unit, GLenum target) {
+        if(unit >= GL_STATE_TEXTURE_UNITS) {
+            return nullptr;
+        }
+        switch(target) {
+            case GL_TEXTURE_2D: return &textures2D[unit];
+            case GL_TEXTURE_2D_ARRAY: return &textures2DArray[unit];
+            case GL_TEXTURE_BUFFER: return &texturesBuffer[unit];
+            default: return nullptr;
+        }
+    }
+
+    GLuint* bufferShadow(GLenum target) {
+        switch(target) {
+            case GL_ARRAY_BUFFER: return &bufferTargets[0];
+            case GL_TEXTURE_BUFFER: return &bufferTargets[1];
+            case GL_DRAW_INDIRECT_BUFFER: return &bufferTargets[2];
+            case GL_COPY_READ_BUFFER: return &bufferTargets[3];
+            case GL_COPY_WRITE_BUFFER: return &bufferTargets[4];
+            case GL_PIXEL_UNPACK_BUFFER: return &bufferTargets[5];
+            default: return nullptr;
+        }
+    }
+
+    GLuint* capabilityShadow(GLenum capability) {
+        switch(capability) {
+            case GL_DEPTH_TEST: return &capabilities[0];
+            case GL_STENCIL_TEST: return &capabilities[1];
+            case GL_BLEND: return &capabilities[2];
+            case GL_PROGRAM_POINT_SIZE: return &capabilities[3];
+            case GL_RASTERIZER_DISCARD: return &capabilities[4];
+            default: return nullptr;
+        }
+    }
+};
@@ -0,0 +1,34 @@
+//--- FNV-1a 64 BIT HASH, USED TO KEY THE CACHES OF BAKED DATA ON THEIR SOURCE FILES
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+inline uint64_t hashBytes(const char* bytes, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t hashValue(uint32_t value, uint64_t hash) {
+    return (hash ^ value) * FNV_PRIME;
+}
+
+//--- RETURNS 0 IF THE FILE CANNOT BE READ
+inline uint64_t hashFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()) {
+        return 0;
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint64_t hash = hashBytes(bytes.data(), bytes.size());
+    return hash ? hash : 1;
+}
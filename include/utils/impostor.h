@@ -0,0 +1,201 @@
+/*
+Impostor class
+- billboard impostor of a model, used to draw the far instances of the trees with a single quad each
+- at bake time the model is rendered from N views around the Y axis, with an orthographic camera framing its
+  bounding sphere, into an atlas of N cells (one row): a colour texture (alpha = coverage) and a normal/depth texture
+  (view space normal, linear depth inside the bounding sphere)
+- at runtime each instance is a quad facing the camera (rotating around the Y axis only, like the views),
+  that samples the cell of the nearest view (see impostor.vert / impostor.frag).
+  The depth of the atlas is used to move the fragments on the surface of the model, so the quads intersect
+  the ground and the other objects like the real geometry
+
+N.B.) the quads have no vertex buffer: the corners are generated in the vertex shader from gl_VertexID,
+an empty VAO is bound only because the core profile requires one for every draw call
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <utils/gl_state.h>
+#include <utils/material_arrays.h>
+
+class Impostor {
+public:
+    GLuint ColorTexture = 0;
+    GLuint NormalDepthTexture = 0;
+    int Views = 0;
+    // bounding sphere of the model, in object space
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+
+    Impostor() = default;
+    Impostor(const Impostor& copy) = delete;
+    Impostor& operator=(const Impostor&) = delete;
+
+    ~Impostor()
+    {
+        if (this->VAO)
+        {
+            GLState::Get().DeleteTextures(1, &this->ColorTexture);
+            GLState::Get().DeleteTextures(1, &this->NormalDepthTexture);
+            GLState::Get().DeleteVertexArrays(1, &this->VAO);
+        }
+    }
+
+    //////////////////////////////////////////
+    // rendering of the views of the model in the atlas. The model is drawn with the texture of its material
+    // the previous framebuffer and viewport are restored at the end
+    void Bake(Model& model, Material material, Shader& shader, int views, int resolution)
+    {
+        this->Views = views;
+        this->computeBounds(model);
+
+        GLint previousFramebuffer, previousViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+        // the atlas is a single row of views: if it is wider than the textures (or the renderbuffers) of the driver,
+        // the views are made smaller, otherwise the framebuffer would be incomplete
+        GLint maxTextureSize, maxRenderbufferSize;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+        int maxWidth = min(maxTextureSize, maxRenderbufferSize);
+        if (resolution * views > maxWidth)
+        {
+            int clamped = max(1, maxWidth / views);
+            cout << "WARNING::IMPOSTOR:: an atlas of " << views << " views of " << resolution << " pixels exceeds the maximum size "
+                 << maxWidth << ", the views are reduced to " << clamped << " pixels" << endl;
+            resolution = clamped;
+        }
+
+        int width = resolution * views;
+        this->ColorTexture = createTexture(GL_RGBA8, width, resolution);
+        this->NormalDepthTexture = createTexture(GL_RGBA8, width, resolution);
+
+        GLuint framebuffer, depthBuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->ColorTexture, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, this->NormalDepthTexture, 0);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, resolution);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::IMPOSTOR:: incomplete framebuffer" << endl;
+
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        shader.Use();
+        // the material arrays are already bound (see MaterialArrays::Bind)
+        MaterialArrays::SetSamplers(shader);
+        glUniform2i(shader.Uniform("material"), material.Array, material.Layer);
+
+        // the camera frames the bounding sphere: the center is at depth 0.5 (see impostor.frag)
+        float r = this->Radius;
+        glm::mat4 projection = glm::ortho(-r, r, -r, r, r, 3.0f * r);
+        glUniformMatrix4fv(shader.Uniform("projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
+
+        for (int i = 0; i < views; i++)
+        {
+            // same azimuth of the view selection in impostor.vert
+            float azimuth = glm::two_pi<float>() * i / views;
+            glm::vec3 direction(sin(azimuth), 0.0f, cos(azimuth));
+            glm::mat4 view = glm::lookAt(this->Center + direction * 2.0f * r, this->Center, glm::vec3(0.0f, 1.0f, 0.0f));
+            glUniformMatrix4fv(shader.Uniform("viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+
+            glViewport(i * resolution, 0, resolution, resolution);
+            model.Draw();
+        }
+
+        GLState::Get().BindTexture(GL_TEXTURE_2D, this->ColorTexture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, this->NormalDepthTexture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, 0);
+
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+        glGenVertexArrays(1, &this->VAO);
+    }
+
+    //////////////////////////////////////////
+    // it sets the uniforms of the impostor in the (active) impostor shader. They don't change after the bake, so it is called once
+    void SetUniforms(Shader& shader)
+    {
+        glUniform1i(shader.Uniform("impostorColor"), 2);
+        glUniform1i(shader.Uniform("impostorNormalDepth"), 3);
+        glUniform3fv(shader.Uniform("impostorCenter"), 1, glm::value_ptr(this->Center));
+        glUniform1f(shader.Uniform("impostorRadius"), this->Radius);
+        glUniform1i(shader.Uniform("impostorViews"), this->Views);
+    }
+
+    //////////////////////////////////////////
+    // it binds the atlas to the units 2 and 3
+    void Bind()
+    {
+        GLState::Get().ActiveTexture(GL_TEXTURE2);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, this->ColorTexture);
+        GLState::Get().ActiveTexture(GL_TEXTURE3);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, this->NormalDepthTexture);
+    }
+
+    //////////////////////////////////////////
+    void DrawInstanced(int instances)
+    {
+        GLState::Get().BindVertexArray(this->VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances);
+    }
+
+private:
+    GLuint VAO = 0;
+
+    //////////////////////////////////////////
+    // bounding sphere around the center of the bounding box of the vertices of the model
+    void computeBounds(Model& model)
+    {
+        glm::vec3 minimum(numeric_limits<float>::max());
+        glm::vec3 maximum(-numeric_limits<float>::max());
+        for (Mesh& mesh : model.meshes)
+            for (Vertex& vertex : mesh.vertices)
+            {
+                minimum = glm::min(minimum, vertex.Position);
+                maximum = glm::max(maximum, vertex.Position);
+            }
+        this->Center = (minimum + maximum) * 0.5f;
+        this->Radius = 0.0f;
+        for (Mesh& mesh : model.meshes)
+            for (Vertex& vertex : mesh.vertices)
+                this->Radius = max(this->Radius, glm::length(vertex.Position - this->Center));
+    }
+
+    static GLuint createTexture(GLenum format, int width, int height)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
@@ -0,0 +1,146 @@
+//--- PER-INSTANCE DATA (E.G. THE COMPACT Instance BELOW) IN A BUFFER TEXTURE, READ BY THE VERTEX SHADER WITH texelFetch
+//--- UNLIKE A UNIFORM ARRAY OR A UNIFORM BLOCK, A BUFFER TEXTURE HAS NO SIZE DECLARED IN THE SHADER: THE BUFFER GROWS
+//--- WITH THE NUMBER OF INSTANCES (UP TO GL_MAX_TEXTURE_BUFFER_SIZE TEXELS, MILLIONS ON DESKTOP DRIVERS), AND
+//--- ONLY THE INSTANCES THAT EXIST ARE UPLOADED. AN INSTANCE IS ONE OR MORE TEXELS OF THE FORMAT OF THE TEXTURE
+//--- (E.G. A mat4 IS FOUR GL_RGBA32F TEXELS, AN Instance IS ONE GL_RGBA32UI TEXEL).
+//--- THE TEXTURE IS BOUND ONCE TO ITS UNIT: RESERVE CAN REALLOCATE THE STORE, BUT THE TEXTURE AND THE BUFFER KEEP THEIR NAMES
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <utils/gl_state.h>
+
+//--- COMPACT INSTANCE: THE TREES ONLY HAVE A POSITION AND A UNIFORM SCALE, THE FOOTPRINTS A POSITION, A YAW AND A FIXED
+//--- SCALE (THE PLANE IS FLAT, SO ITS SCALE ON Y DOESN'T MATTER). 16 BYTES, ONE GL_RGBA32UI TEXEL, INSTEAD OF THE 64 OF A mat4:
+//--- x, y, z ARE THE BITS OF THE FLOATS OF THE POSITION, w HAS THE YAW (16 BIT UNORM OF [0, 2PI)) IN THE LOW HALF AND
+//--- THE SCALE (4.12 FIXED POINT, [0, 16)) IN THE HIGH ONE. THE VERTEX SHADER REBUILDS THE MATRIX (SEE instanceMatrix IN base.vert)
+#define INSTANCE_YAW_STEPS 65536.0f
+#define INSTANCE_SCALE_STEPS 4096.0f
+
+struct Instance {
+    glm::vec3 Position;
+    uint32_t YawScale;
+
+    static Instance Make(glm::vec3 position, float yaw, float scale) {
+        const float twoPi = 6.28318530718f;
+        float turns = yaw / twoPi - std::floor(yaw / twoPi);
+        uint32_t yawBits = (uint32_t)std::lround(turns * INSTANCE_YAW_STEPS) & 0xFFFF;
+        uint32_t scaleBits = (uint32_t)std::min(std::lround(std::max(scale, 0.0f) * INSTANCE_SCALE_STEPS), 0xFFFFL);
+        return { position, yawBits | (scaleBits << 16) };
+    }
+
+    //--- THE DECODED VALUES ARE THE ONES USED BY THE SHADER, SO THE CPU (COLLISIONS, LODS) SEES THE SAME INSTANCE
+    float Yaw() const {
+        return (YawScale & 0xFFFF) / INSTANCE_YAW_STEPS * 6.28318530718f;
+    }
+
+    float Scale() const {
+        return (YawScale >> 16) / INSTANCE_SCALE_STEPS;
+    }
+
+    glm::mat4 Matrix() const {
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), Position);
+        matrix = glm::rotate(matrix, Yaw(), glm::vec3(0.0f, 1.0f, 0.0f));
+        return glm::scale(matrix, glm::vec3(Scale()));
+    }
+};
+
+static_assert(sizeof(Instance) == 16, "Instance must be a single RGBA32UI texel");
+
+class InstanceBuffer {
+    public:
+
+    InstanceBuffer(GLenum format, GLsizeiptr instanceSize) : format(format), instanceSize(instanceSize) {}
+
+    InstanceBuffer(const InstanceBuffer& copy) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    //--- MAKES ROOM FOR count INSTANCES. IT RETURNS TRUE IF THE STORE HAS BEEN REALLOCATED: THE OLD CONTENT IS LOST,
+    //--- AND ALL THE INSTANCES MUST BE UPLOADED AGAIN
+    bool Reserve(size_t count) {
+        if(!buffer) {
+            glGenBuffers(1, &buffer);
+            glGenTextures(1, &texture);
+        } else if(count <= capacity) {
+            return false;
+        }
+
+        //--- DOUBLING KEEPS THE REALLOCATIONS RARE WHEN THE INSTANCES ARE ADDED ONE BY ONE (MAP RELOAD)
+        capacity = std::max(std::max(count, capacity * 2), (size_t)1);
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        //--- THE FORMATS ARE RGBA32 TEXELS, 16 BYTES, OR R32 ONES (INDEXES), 4 BYTES
+        GLsizeiptr texelSize = (format == GL_R32I || format == GL_R32UI || format == GL_R32F) ? 4 : 16;
+        if(capacity * instanceSize / texelSize > (size_t)maxTexels) {
+            std::cout << "WARNING::INSTANCE-BUFFER:: " << capacity << " instances exceed the buffer textures of the driver" << std::endl;
+        }
+
+        GLState::Get().BindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capacity * instanceSize, NULL, GL_DYNAMIC_DRAW);
+        GLState::Get().BindBuffer(GL_TEXTURE_BUFFER, 0);
+        Attach(texture, format, buffer);
+        return true;
+    }
+
+    //--- REPLACES ALL THE INSTANCES
+    void Upload(const void* data, size_t count) {
+        Reserve(count);
+        Update(data, 0, count);
+    }
+
+    //--- REPLACES THE INSTANCES [first, first + count), WHICH MUST BE ALREADY RESERVED
+    void Update(const void* data, size_t first, size_t count) {
+        if(count == 0) {
+            return;
+        }
+        GLState::Get().BindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, first * instanceSize, count * instanceSize, data);
+    }
+
+    //--- BINDS THE TEXTURE TO ITS UNIT, LEAVING GL_TEXTURE1 ACTIVE (LIKE MaterialArrays::Bind)
+    void Bind(GLuint unit) {
+        BindTexture(texture, unit);
+    }
+
+    //--- THE BUFFER CAN ALSO BE WRITTEN BY THE GPU (E.G. BY TRANSFORM FEEDBACK)
+    GLuint Buffer() const {
+        return buffer;
+    }
+
+    //--- LIKE Shader::Delete, TO BE CALLED WHILE THE CONTEXT IS STILL ALIVE
+    void Delete() {
+        GLState::Get().DeleteTextures(1, &texture);
+        GLState::Get().DeleteBuffers(1, &buffer);
+        texture = 0;
+        buffer = 0;
+        capacity = 0;
+    }
+
+    //--- A BUFFER TEXTURE CAN ALSO READ A BUFFER OWNED BY SOMEONE ELSE (E.G. A StreamBuffer)
+    static void Attach(GLuint texture, GLenum format, GLuint buffer) {
+        GLState::Get().BindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        GLState::Get().BindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    static void BindTexture(GLuint texture, GLuint unit) {
+        GLState::Get().ActiveTexture(GL_TEXTURE0 + unit);
+        GLState::Get().BindTexture(GL_TEXTURE_BUFFER, texture);
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+    }
+
+    private:
+
+    GLenum format;
+    GLsizeiptr instanceSize;
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t capacity = 0;
+};
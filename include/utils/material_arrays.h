@@ -0,0 +1,198 @@
+/*
+MaterialArrays class
+- the textures of the materials of the scene are packed in GL_TEXTURE_2D_ARRAYs: the textures with the same size
+  and format are the layers of the same array, so a material is just a pair (array, layer)
+- all the arrays are bound once, to consecutive texture units starting from MATERIAL_FIRST_UNIT, and the shaders
+  select the array and the layer with a uniform (see materialTexture in base.frag): changing material between
+  two draws is a glUniform2i, and not a texture bind
+- the number of layers of an array is known only when all its textures are decoded: Reserve collects the size of
+  every texture, Allocate creates the storage of the arrays, Upload copies each texture in its layer
+  (the BC1 levels baked by TextureCache as they are, the raw pixels with a glGenerateMipmap on the whole array).
+  The copies go through the staging buffers of an UploadPool, so the transfers to the GPU don't block the app
+
+The shaders declare "uniform sampler2DArray materials[MAX_MATERIAL_ARRAYS]": the size must be the same of the define.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <utils/gl_state.h>
+#include <utils/upload_pool.h>
+
+// maximum number of arrays (different sizes/formats of the textures), it must match the size of the sampler array in the shaders
+#define MAX_MATERIAL_ARRAYS 8
+// the units below are used by the other textures (render targets, impostor atlas)
+#define MATERIAL_FIRST_UNIT 4
+
+// array of the materials that didn't get a layer (see Reserve)
+#define MATERIAL_INVALID_ARRAY -1
+
+// position of the texture of a material
+struct Material {
+    GLint Array = 0;
+    GLint Layer = 0;
+
+    bool IsValid() const
+    {
+        return this->Array != MATERIAL_INVALID_ARRAY;
+    }
+};
+
+class MaterialArrays
+{
+public:
+    MaterialArrays() = default;
+    MaterialArrays(const MaterialArrays& copy) = delete;
+    MaterialArrays& operator=(const MaterialArrays&) = delete;
+
+    //////////////////////////////////////////
+    // it assigns a layer to a texture: compressed textures have all their levels already, raw ones have the full chain generated
+    Material Reserve(int width, int height, bool compressed, int levels)
+    {
+        Material material;
+        for (size_t i = 0; i < this->arrays.size(); i++)
+        {
+            Array& array = this->arrays[i];
+            if (array.Width == width && array.Height == height && array.Compressed == compressed && array.Levels == levels)
+            {
+                material.Array = (GLint)i;
+                material.Layer = array.Layers++;
+                return material;
+            }
+        }
+
+        if (this->arrays.size() == MAX_MATERIAL_ARRAYS)
+        {
+            cout << "ERROR::MATERIALS:: too many texture sizes, the texture is not uploaded" << endl;
+            material.Array = MATERIAL_INVALID_ARRAY;
+            return material;
+        }
+        this->arrays.push_back({ 0, width, height, compressed, levels, 1 });
+        material.Array = (GLint)this->arrays.size() - 1;
+        return material;
+    }
+
+    //////////////////////////////////////////
+    // it creates the storage of every level of every array
+    void Allocate()
+    {
+        for (Array& array : this->arrays)
+        {
+            glGenTextures(1, &array.Texture);
+            GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, array.Texture);
+            int w = array.Width;
+            int h = array.Height;
+            for (int level = 0; level < array.Levels; level++)
+            {
+                if (array.Compressed)
+                    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, array.Layers, 0, TextureCache::BlocksSize(w, h) * array.Layers, NULL);
+                else
+                    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, w, h, array.Layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                w = max(1, w / 2);
+                h = max(1, h / 2);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.Levels - 1);
+            // same sampling of the 2D textures of the scene
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    //////////////////////////////////////////
+    // it copies the baked levels in the layer of the material (nothing for an invalid material)
+    void Upload(Material material, const CompressedTexture& texture, UploadPool& pool)
+    {
+        if (!material.IsValid())
+            return;
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, this->arrays[material.Array].Texture);
+        int w = texture.Width;
+        int h = texture.Height;
+        for (size_t level = 0; level < texture.Levels.size(); level++)
+        {
+            const vector<uint8_t>& blocks = texture.Levels[level];
+            pool.Upload(blocks.data(), blocks.size(), [&](const GLvoid* pixels) {
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, material.Layer, w, h, 1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, blocks.size(), pixels);
+            });
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    //////////////////////////////////////////
+    // it copies an RGB image in the first level of the layer of the material, the other levels are made by GenerateMipmaps
+    void Upload(Material material, const unsigned char* rgb, int width, int height, UploadPool& pool)
+    {
+        if (!material.IsValid())
+            return;
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, this->arrays[material.Array].Texture);
+        pool.Upload(rgb, (GLsizeiptr)width * height * 3, [&](const GLvoid* pixels) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, material.Layer, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        });
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    //////////////////////////////////////////
+    // to be called after the upload of all the layers: one glGenerateMipmap for each array of raw textures
+    void GenerateMipmaps()
+    {
+        for (Array& array : this->arrays)
+        {
+            if (array.Compressed)
+                continue;
+            GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, array.Texture);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    //////////////////////////////////////////
+    // it binds every array to its unit. The bindings are never changed by the rendering, so it is called once
+    void Bind()
+    {
+        for (size_t i = 0; i < this->arrays.size(); i++)
+        {
+            GLState::Get().ActiveTexture(GL_TEXTURE0 + MATERIAL_FIRST_UNIT + i);
+            GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, this->arrays[i].Texture);
+        }
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+    }
+
+    //////////////////////////////////////////
+    // it connects the sampler array of a program to the units of the arrays. The program must be in use
+    static void SetSamplers(Shader& shader)
+    {
+        GLint units[MAX_MATERIAL_ARRAYS];
+        for (int i = 0; i < MAX_MATERIAL_ARRAYS; i++)
+            units[i] = MATERIAL_FIRST_UNIT + i;
+        glUniform1iv(shader.Uniform("materials"), MAX_MATERIAL_ARRAYS, units);
+    }
+
+    // like Shader::Delete, to be called while the context is still alive
+    void Delete()
+    {
+        for (Array& array : this->arrays)
+            GLState::Get().DeleteTextures(1, &array.Texture);
+        this->arrays.clear();
+    }
+
+private:
+    struct Array {
+        GLuint Texture;
+        int Width;
+        int Height;
+        bool Compressed;
+        int Levels;
+        int Layers;
+    };
+
+    vector<Array> arrays;
+};
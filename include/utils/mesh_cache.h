@@ -0,0 +1,149 @@
+/*
+MeshCache class
+- binary cache of the processed meshes of a model, stored next to the source file (e.g. ../models/dog.obj.cache)
+- the cache is keyed by a hash of the source file, the Assimp post-processing flags, the optimizations applied to
+  the meshes (see mesh_optimizer.h) and the number of their LODs (see mesh_simplifier.h), the size of the Vertex structure and the cache version: if any of them changes, the cache is ignored and rebuilt
+- on warm starts the vertices and indices are read straight into the vectors used by the Mesh class,
+  so loading a model becomes a couple of reads instead of a full Assimp import
+
+Cache layout:
+header | for each mesh: vertex count, index count, LOD count, Vertex array, index array (all the LODs), MeshLod array
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <utils/hash.h>
+
+// to be incremented every time the layout of the file or the processing of the meshes changes
+#define MESH_CACHE_VERSION 3
+
+struct MeshCacheHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t MeshCount;
+};
+
+class MeshCache
+{
+public:
+    MeshCache(const string& sourcePath, unsigned int flags, unsigned int optimizations)
+        : cachePath(sourcePath + ".cache")
+    {
+        this->key = computeKey(sourcePath, flags, optimizations);
+    }
+
+    //////////////////////////////////////////
+    // it fills the vector with the cached meshes. It returns false if the cache is missing or stale
+    bool Load(vector<MeshData>& meshes)
+    {
+        if (!this->key)
+            return false;
+
+        ifstream file(this->cachePath, ios::binary | ios::ate);
+        if (!file.is_open())
+            return false;
+        uint64_t remaining = (uint64_t)file.tellg();
+        file.seekg(0);
+
+        MeshCacheHeader header;
+        if (remaining < sizeof(header))
+            return false;
+        file.read((char*)&header, sizeof(header));
+        if (!file || memcmp(header.Magic, "RTMC", 4) != 0 || header.Version != MESH_CACHE_VERSION || header.Key != this->key)
+            return false;
+        remaining -= sizeof(header);
+
+        // the counts of a truncated or corrupted file could ask for any size: they are checked against the bytes
+        // left in the file before allocating anything, and any mismatch is a cache miss
+        uint32_t counts[3];
+        if ((uint64_t)header.MeshCount * sizeof(counts) > remaining)
+            return false;
+        vector<MeshData> loaded(header.MeshCount);
+        for (MeshData& mesh : loaded)
+        {
+            if (remaining < sizeof(counts))
+                return false;
+            file.read((char*)counts, sizeof(counts));
+            if (!file)
+                return false;
+            remaining -= sizeof(counts);
+            uint64_t bytes = (uint64_t)counts[0] * sizeof(Vertex) + (uint64_t)counts[1] * sizeof(GLuint) + (uint64_t)counts[2] * sizeof(MeshLod);
+            if (bytes > remaining)
+                return false;
+            remaining -= bytes;
+            mesh.vertices.resize(counts[0]);
+            mesh.indices.resize(counts[1]);
+            mesh.lods.resize(counts[2]);
+            file.read((char*)mesh.vertices.data(), counts[0] * sizeof(Vertex));
+            file.read((char*)mesh.indices.data(), counts[1] * sizeof(GLuint));
+            file.read((char*)mesh.lods.data(), counts[2] * sizeof(MeshLod));
+            if (!file)
+                return false;
+        }
+        if (remaining != 0)
+            return false;
+
+        meshes = std::move(loaded);
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // it writes the processed meshes to the cache file.
+    // A failed import has no meshes: it is not cached, so the next launch tries to import the model again
+    void Save(const vector<MeshData>& meshes)
+    {
+        if (!this->key || meshes.empty())
+            return;
+
+        ofstream file(this->cachePath, ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            cout << "WARNING::MESH_CACHE:: unable to write " << this->cachePath << endl;
+            return;
+        }
+
+        MeshCacheHeader header;
+        memcpy(header.Magic, "RTMC", 4);
+        header.Version = MESH_CACHE_VERSION;
+        header.Key = this->key;
+        header.MeshCount = (uint32_t)meshes.size();
+        file.write((const char*)&header, sizeof(header));
+
+        for (const MeshData& mesh : meshes)
+        {
+            uint32_t counts[3] = { (uint32_t)mesh.vertices.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.lods.size() };
+            file.write((const char*)counts, sizeof(counts));
+            file.write((const char*)mesh.vertices.data(), counts[0] * sizeof(Vertex));
+            file.write((const char*)mesh.indices.data(), counts[1] * sizeof(GLuint));
+            file.write((const char*)mesh.lods.data(), counts[2] * sizeof(MeshLod));
+        }
+    }
+
+private:
+    string cachePath;
+    // 0 if the source file cannot be read
+    uint64_t key;
+
+    //////////////////////////////////////////
+    // hash of the source file, combined with everything that changes the processed data
+    uint64_t computeKey(const string& sourcePath, unsigned int flags, unsigned int optimizations)
+    {
+        uint64_t hash = hashFile(sourcePath);
+        if (!hash)
+            return 0;
+
+        uint32_t settings[5] = { flags, optimizations, MAX_LODS, (uint32_t)sizeof(Vertex), MESH_CACHE_VERSION };
+        for (uint32_t setting : settings)
+            hash = hashValue(setting, hash);
+
+        return hash ? hash : 1;
+    }
+};
@@ -0,0 +1,266 @@
+/*
+Mesh optimizer
+- post-import stage applied to the meshes before they are cached (see Model::Import)
+- vertex cache optimization: the triangles are reordered with the linear-speed algorithm by Tom Forsyth
+  (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html), so consecutive triangles reuse the
+  vertices just transformed by the GPU, and the post-transform cache has fewer misses
+- overdraw optimization (optional): the reordered triangles are split in clusters at the points where the cache
+  is "restarted", and the clusters are sorted so that the outward-facing ones are drawn first (Tipsify-like sorting,
+  see Sander, Nehab, Barczak - "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"): they are more
+  likely to occlude the others, that are then rejected by the depth test
+- the stage is applied to each LOD of the mesh (see mesh_simplifier.h)
+- vertex fetch optimization: the vertices are renumbered in the order of their first use in the index buffer,
+  so the vertex fetches walk the VBO almost linearly. Unreferenced vertices are removed
+
+The index buffer is then uploaded with 16 bit indices by Mesh, if the mesh has less than 65536 vertices.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// size of the simulated post-transform cache
+#define VERTEX_CACHE_SIZE 32
+// a new cluster starts when a triangle is made of vertices that are all cache misses
+#define OVERDRAW_CLUSTER_MISSES 3
+
+//////////////////////////////////////////
+// score of a vertex, as in the Forsyth paper: higher for vertices in the most recent cache positions,
+// and for vertices with few triangles left (to avoid leaving isolated triangles behind)
+inline float vertexScore(int cachePosition, int liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // the last triangle added has a fixed score, so that it is not reused immediately
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = pow(1.0f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * pow((float)liveTriangles, -0.5f);
+}
+
+//////////////////////////////////////////
+// reorder of the triangles for the post-transform vertex cache
+inline void optimizeVertexCache(vector<GLuint>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // adjacency: for each vertex, the list of the triangles using it
+    vector<int> liveTriangles(vertexCount, 0);
+    for (GLuint index : indices)
+        liveTriangles[index]++;
+    vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    vector<size_t> adjacency(indices.size());
+    vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[filled[indices[i]]++] = i / 3;
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, liveTriangles[v]);
+
+    vector<float> triangleScore(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    vector<GLuint> cache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    // next triangle to check when the cache does not suggest any candidate
+    size_t nextInput = 0;
+    long best = 0;
+
+    for (size_t count = 0; count < triangleCount; count++)
+    {
+        if (best < 0)
+        {
+            // linear scan of the remaining triangles: it only happens when a "island" of the mesh is completed
+            while (emitted[nextInput])
+                nextInput++;
+            best = (long)nextInput;
+        }
+
+        // the triangle is emitted, and its vertices are moved to the front of the cache
+        emitted[best] = true;
+        GLuint triangle[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+        for (int k = 0; k < 3; k++)
+        {
+            result.push_back(triangle[k]);
+            liveTriangles[triangle[k]]--;
+        }
+
+        vector<GLuint> updated(triangle, triangle + 3);
+        for (GLuint vertex : cache)
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                updated.push_back(vertex);
+        // vertices pushed out of the cache lose their cache score
+        vector<GLuint> changed(updated.begin() + min(updated.size(), (size_t)VERTEX_CACHE_SIZE), updated.end());
+        for (GLuint vertex : changed)
+            cachePosition[vertex] = -1;
+        if (updated.size() > VERTEX_CACHE_SIZE)
+            updated.resize(VERTEX_CACHE_SIZE);
+        cache.swap(updated);
+
+        for (size_t i = 0; i < cache.size(); i++)
+            cachePosition[cache[i]] = (int)i;
+
+        // only the vertices in the cache and the ones just pushed out of it have changed their score,
+        // and with them the triangles using them
+        changed.insert(changed.end(), cache.begin(), cache.end());
+        best = -1;
+        float bestScore = -1.0f;
+        for (GLuint vertex : changed)
+            score[vertex] = vertexScore(cachePosition[vertex], liveTriangles[vertex]);
+        for (GLuint vertex : changed)
+        {
+            for (size_t a = firstTriangle[vertex]; a < firstTriangle[vertex + 1]; a++)
+            {
+                size_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = (long)t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+//////////////////////////////////////////
+// sort of the clusters of the (cache optimized) triangles, from the most outward-facing to the most inward-facing
+inline void optimizeOverdraw(vector<GLuint>& indices, const vector<Vertex>& vertices)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertices.empty())
+        return;
+
+    // split in clusters, simulating a FIFO cache
+    vector<size_t> clusterStart;
+    vector<GLuint> fifo;
+    vector<bool> cached(vertices.size(), false);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            GLuint vertex = indices[t * 3 + k];
+            if (cached[vertex])
+                continue;
+            misses++;
+            fifo.push_back(vertex);
+            cached[vertex] = true;
+            if (fifo.size() > VERTEX_CACHE_SIZE)
+            {
+                cached[fifo.front()] = false;
+                fifo.erase(fifo.begin());
+            }
+        }
+        if (t == 0 || misses >= OVERDRAW_CLUSTER_MISSES)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+
+    glm::vec3 meshCenter(0.0f);
+    for (const Vertex& vertex : vertices)
+        meshCenter += vertex.Position;
+    meshCenter /= (float)vertices.size();
+
+    // sort key of a cluster: distance of its center from the center of the mesh, along the average normal of the cluster
+    size_t clusterCount = clusterStart.size() - 1;
+    vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            glm::vec3 p0 = vertices[indices[t * 3]].Position;
+            glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+            // the cross product is weighted by the area of the triangle
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            center += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        if (area > 0.0f)
+            center /= area;
+        float length = glm::length(normal);
+        sortKey[c] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+    }
+
+    vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    indices.swap(result);
+}
+
+//////////////////////////////////////////
+// renumbering of the vertices in the order of their first use in the index buffer
+inline void optimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    const GLuint unused = (GLuint)-1;
+    vector<GLuint> remap(vertices.size(), unused);
+    vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (GLuint& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (GLuint)result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+//////////////////////////////////////////
+// the whole stage, in the order needed by the single steps: the overdraw sort works on the cache-optimized clusters,
+// and the vertex fetch order follows the final order of the triangles.
+// The triangles of each LOD are reordered separately; the vertices follow the order of the full detail LOD,
+// that comes first in the index buffer (the other LODs use a subset of its vertices)
+inline void optimizeMesh(MeshData& mesh, bool overdraw)
+{
+    if (mesh.lods.empty())
+        mesh.lods.push_back({ 0, (uint32_t)mesh.indices.size(), 0.0f });
+
+    for (const MeshLod& lod : mesh.lods)
+    {
+        vector<GLuint> range(mesh.indices.begin() + lod.IndexOffset, mesh.indices.begin() + lod.IndexOffset + lod.IndexCount);
+        optimizeVertexCache(range, mesh.vertices.size());
+        if (overdraw)
+            optimizeOverdraw(range, mesh.vertices);
+        copy(range.begin(), range.end(), mesh.indices.begin() + lod.IndexOffset);
+    }
+    optimizeVertexFetch(mesh.vertices, mesh.indices);
+}
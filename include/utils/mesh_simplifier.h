@@ -0,0 +1,263 @@
+/*
+Mesh simplifier
+- generation of a chain of levels of detail (LODs) of a mesh, with quadric error metrics edge collapse
+  (Garland, Heckbert - "Surface Simplification Using Quadric Error Metrics")
+- the collapses are "endpoint" collapses: a vertex is merged into one of its neighbours, so no new vertex is created.
+  Every LOD is just a different index buffer over the same vertices, and all the LODs of a mesh are stored
+  one after the other in its index buffer (see MeshLod)
+- vertices on the open borders of the mesh and on the UV seams (vertices with the same position and different
+  attributes, split by Assimp) are locked, so the simplified meshes have no holes
+- each LOD stores the geometric error of its simplification (the distance from the original surface, in object space):
+  at run time it is projected on the screen to choose the LOD to draw (see Model::SelectLod)
+
+The LODs are generated at import time, before the optimization of the meshes (see Model::Import), and cached with them.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// maximum number of LODs of a mesh, including the full detail one
+#define MAX_LODS 4
+// each LOD has half the triangles of the previous one
+#define LOD_REDUCTION 0.5f
+// a LOD is discarded if the simplification could not remove at least this fraction of the triangles of the previous one
+#define LOD_MIN_REDUCTION 0.1f
+
+// symmetric 4x4 matrix of the quadric, stored as its 10 distinct coefficients
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    // total area of the planes, to turn the error back into a squared distance
+    double w = 0;
+
+    // quadric of the plane ax + by + cz + d = 0, weighted by the area of the triangle
+    static Quadric fromPlane(glm::dvec3 n, double d, double weight)
+    {
+        Quadric q;
+        q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight; q.ad = n.x * d * weight;
+        q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+        q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+        q.d2 = d * d * weight;
+        q.w = weight;
+        return q;
+    }
+
+    void add(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+        bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        w += q.w;
+    }
+
+    // sum of the squared distances of the point from the planes of the quadric
+    double error(glm::dvec3 p) const
+    {
+        double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                 + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                 + c2 * p.z * p.z + 2 * cd * p.z
+                 + d2;
+        return e > 0 ? e : 0;
+    }
+};
+
+//////////////////////////////////////////
+// it simplifies the triangles in indices until there are at most targetIndexCount indices left, or no collapse is possible.
+// It returns the simplified indices, and the error of the simplification (in object space units)
+inline vector<GLuint> simplifyMesh(const vector<Vertex>& vertices, const vector<GLuint>& indices, size_t targetIndexCount, float& resultError)
+{
+    size_t vertexCount = vertices.size();
+    vector<GLuint> result = indices;
+    resultError = 0.0f;
+
+    // vertices with the same position are the same "geometric" vertex: they are welded to find the borders of the surface
+    vector<GLuint> weld(vertexCount);
+    vector<int> wedges(vertexCount, 0);
+    map<tuple<float, float, float>, GLuint> positions;
+    for (GLuint v = 0; v < vertexCount; v++)
+    {
+        const glm::vec3& p = vertices[v].Position;
+        weld[v] = positions.emplace(make_tuple(p.x, p.y, p.z), v).first->second;
+        wedges[weld[v]]++;
+    }
+
+    // locked vertices: seams (more than one vertex in the same position) and open borders (edges used by one triangle only)
+    vector<bool> locked(vertexCount, false);
+    for (GLuint v = 0; v < vertexCount; v++)
+        locked[v] = wedges[weld[v]] > 1;
+    map<pair<GLuint, GLuint>, int> edges;
+    for (size_t i = 0; i < result.size(); i += 3)
+        for (int k = 0; k < 3; k++)
+        {
+            GLuint a = weld[result[i + k]];
+            GLuint b = weld[result[i + (k + 1) % 3]];
+            edges[make_pair(min(a, b), max(a, b))]++;
+        }
+    for (const auto& edge : edges)
+        if (edge.second == 1)
+            locked[edge.first.first] = locked[edge.first.second] = true;
+    for (GLuint v = 0; v < vertexCount; v++)
+        locked[v] = locked[v] || locked[weld[v]];
+
+    // quadric of each vertex, from the planes of its triangles
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        glm::dvec3 p0 = vertices[result[i]].Position;
+        glm::dvec3 p1 = vertices[result[i + 1]].Position;
+        glm::dvec3 p2 = vertices[result[i + 2]].Position;
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+        if (area <= 0)
+            continue;
+        n /= area;
+        Quadric q = Quadric::fromPlane(n, -glm::dot(n, p0), area * 0.5);
+        for (int k = 0; k < 3; k++)
+            quadrics[result[i + k]].add(q);
+    }
+
+    struct Collapse {
+        GLuint From;
+        GLuint To;
+        // area weighted squared distance
+        double Cost;
+    };
+
+    // each pass collapses the cheapest edges, with at most one collapse around each vertex
+    while (result.size() > targetIndexCount)
+    {
+        vector<Collapse> collapses;
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint a = result[i + k];
+                GLuint b = result[i + (k + 1) % 3];
+                // both directions of the edge are evaluated, the cheapest (allowed) one is kept
+                double costAB = locked[a] ? -1 : quadrics[a].error(vertices[b].Position) + quadrics[b].error(vertices[b].Position);
+                double costBA = locked[b] ? -1 : quadrics[a].error(vertices[a].Position) + quadrics[b].error(vertices[a].Position);
+                if (costAB >= 0 && (costBA < 0 || costAB <= costBA))
+                    collapses.push_back({ a, b, costAB });
+                else if (costBA >= 0)
+                    collapses.push_back({ b, a, costBA });
+            }
+        if (collapses.empty())
+            break;
+        sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Cost < y.Cost; });
+
+        // triangles around each vertex
+        vector<vector<size_t>> triangles(vertexCount);
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                triangles[result[i + k]].push_back(i);
+
+        vector<GLuint> remap(vertexCount);
+        for (GLuint v = 0; v < vertexCount; v++)
+            remap[v] = v;
+        vector<bool> touched(vertexCount, false);
+        // each collapse removes (usually) two triangles
+        size_t removable = (result.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= removable)
+                break;
+            if (touched[collapse.From] || touched[collapse.To])
+                continue;
+
+            // the collapse is rejected if a triangle around the removed vertex flips
+            glm::vec3 target = vertices[collapse.To].Position;
+            bool flips = false;
+            int degenerate = 0;
+            for (size_t t : triangles[collapse.From])
+            {
+                GLuint v[3] = { result[t], result[t + 1], result[t + 2] };
+                if (v[0] == collapse.To || v[1] == collapse.To || v[2] == collapse.To)
+                {
+                    degenerate++;
+                    continue;
+                }
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; k++)
+                    p[k] = v[k] == collapse.From ? target : vertices[v[k]].Position;
+                glm::vec3 before = glm::cross(vertices[v[1]].Position - vertices[v[0]].Position, vertices[v[2]].Position - vertices[v[0]].Position);
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                if (glm::dot(before, after) <= 0.0f)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips)
+                continue;
+
+            // average squared distance of the merged vertex from the planes of the quadric
+            double weight = quadrics[collapse.From].w + quadrics[collapse.To].w;
+            if (weight > 0)
+                resultError = max(resultError, (float)sqrt(collapse.Cost / weight));
+            remap[collapse.From] = collapse.To;
+            quadrics[collapse.To].add(quadrics[collapse.From]);
+            // the vertices of all the triangles around the collapsed edge are frozen until the next pass
+            for (size_t t : triangles[collapse.From])
+                for (int k = 0; k < 3; k++)
+                    touched[result[t + k]] = true;
+            for (size_t t : triangles[collapse.To])
+                for (int k = 0; k < 3; k++)
+                    touched[result[t + k]] = true;
+            removed += degenerate;
+        }
+        if (removed == 0)
+            break;
+
+        // the triangles are rewritten with the collapsed vertices, the degenerate ones are removed
+        vector<GLuint> simplified;
+        simplified.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            GLuint a = remap[result[i]];
+            GLuint b = remap[result[i + 1]];
+            GLuint c = remap[result[i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                simplified.push_back(a);
+                simplified.push_back(b);
+                simplified.push_back(c);
+            }
+        }
+        result.swap(simplified);
+    }
+
+    return result;
+}
+
+//////////////////////////////////////////
+// it appends to the index buffer of the mesh the simplified LODs, and it fills the LOD ranges.
+// Each LOD is simplified from the full detail mesh, so its error is measured against the original surface
+inline void generateLods(MeshData& mesh)
+{
+    size_t fullCount = mesh.indices.size();
+    mesh.lods.clear();
+    mesh.lods.push_back({ 0, (uint32_t)fullCount, 0.0f });
+
+    vector<GLuint> full(mesh.indices.begin(), mesh.indices.end());
+    size_t previousCount = fullCount;
+    float target = 1.0f;
+    for (int lod = 1; lod < MAX_LODS; lod++)
+    {
+        target *= LOD_REDUCTION;
+        size_t targetCount = (size_t)(fullCount / 3 * target) * 3;
+        float error = 0.0f;
+        vector<GLuint> simplified = simplifyMesh(mesh.vertices, full, targetCount, error);
+        if (simplified.empty() || simplified.size() > previousCount * (1.0f - LOD_MIN_REDUCTION))
+            break;
+
+        mesh.lods.push_back({ (uint32_t)mesh.indices.size(), (uint32_t)simplified.size(), error });
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        previousCount = simplified.size();
+    }
+}
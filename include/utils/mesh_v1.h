@@ -1,6 +1,7 @@
 /*
 Mesh class - v1
-- the class allocates and initializes VBO, VAO, and EBO buffers, and it sets as OpenGL must consider the data in the buffers
+- the class converts the vertices in the format of its layout and copies them, with the indices, in the shared
+  VBO and EBO of the GeometryArena of the layout, which also owns the VAO that tells OpenGL how to consider the data
 
 VBO : Vertex Buffer Object - memory allocated on GPU memory to store the mesh data (vertices and their attributes, like e.g. normals, etc)
 EBO : Element Buffer Object - a buffer maintaining the indices of vertices composing the mesh faces
@@ -9,13 +10,16 @@ See https://learnopengl.com/#!Getting-started/Hello-Triangle for details.
 
 N.B. 1)
 Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
-Mesh class is in charge of releasing the allocated GPU buffers, and
-it is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
-Moreover, we want to have, CPU-side, a Mesh instance, with associated GPU resources, which is responsible of their life cycle (RAII), and which could be "moved" in memory keeping the ownership of its resources
+The GPU buffers are owned by the GeometryArena, and Mesh
+is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
+Moreover, we want to have, CPU-side, a Mesh instance, with its suballocation of the arena, which could be "moved" in memory keeping its position in the arena
 
 N.B. 2) no texturing in this version of the class
 
-N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
+N.B. 3) the layout of the vertices in the VBO is described by a VertexFormat (see vertex_format.h):
+by default the meshes are uploaded with the compact 16 bytes layout, instead of the 56 bytes of the Vertex structure
+
+N.B. 4) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
 
 author: Davide Gadia, Michael Marchesan
 
@@ -50,14 +54,55 @@ struct Point {
     glm::vec3 Position;
 };
 
+// range of the index buffer of a mesh with the triangles of a level of detail (see mesh_simplifier.h)
+struct MeshLod {
+    uint32_t IndexOffset;
+    uint32_t IndexCount;
+    // distance from the original surface, in object space
+    float Error;
+};
+
+// record read by glDrawElementsIndirect from GL_DRAW_INDIRECT_BUFFER (the layout is fixed by the OpenGL specification)
+struct DrawElementsIndirectCommand {
+    GLuint Count;
+    GLuint InstanceCount;
+    // in indices, not in bytes
+    GLuint FirstIndex;
+    GLint BaseVertex;
+    // must be 0 before GL 4.2
+    GLuint BaseInstance;
+};
+
+// CPU-side data of a mesh, before the creation of the GPU buffers
+// the indices of all the LODs are stored one after the other; if lods is empty, all the indices are a single LOD
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    vector<MeshLod> lods;
+};
+
+// descriptors of the layouts of the vertices in the VBO
+#include <utils/vertex_format.h>
+
+// shared buffers of the static meshes
+#include <utils/geometry_arena.h>
+
 /////////////////// MESH class ///////////////////////
 class Mesh {
 public:
     // data structures for vertices, and indices of vertices (for faces)
     vector<Vertex> vertices;
     vector<GLuint> indices;
-    // VAO
-    GLuint VAO;
+    // layout of the vertices in the VBO
+    VertexLayout layout;
+    // transform from the quantized positions to the object space ones (identity for the Full layout)
+    Dequantization dequantization;
+    // GL_UNSIGNED_SHORT if the mesh has less than 65536 vertices, GL_UNSIGNED_INT otherwise
+    GLenum indexType;
+    // ranges of the index buffer with the levels of detail, the first one is the full detail mesh
+    vector<MeshLod> lods;
+    // position of the vertices and of the indices of the mesh in the buffers of the arena of its layout
+    ArenaAllocation allocation;
 
     // We want Mesh to be a move-only class. We delete copy constructor and copy assignment
     // see:
@@ -72,145 +117,123 @@ public:
     // Constructor
     // We use initializer list and std::move in order to avoid a copy of the arguments
     // This constructor empties the source vectors (vertices and indices)
-    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices) noexcept
-        : vertices(std::move(vertices)), indices(std::move(indices))
+    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices, VertexLayout layout = VertexLayout::Compact) noexcept
+        : vertices(std::move(vertices)), indices(std::move(indices)), layout(layout)
     {
+        this->lods.push_back({ 0, (uint32_t)this->indices.size(), 0.0f });
         this->setupMesh();
     }
 
-    // We implement a user-defined move constructor and move assignment
+    // Constructor from imported data, with its levels of detail. It empties the source data
+    Mesh(MeshData& data, VertexLayout layout = VertexLayout::Compact) noexcept
+        : vertices(std::move(data.vertices)), indices(std::move(data.indices)), layout(layout), lods(std::move(data.lods))
+    {
+        if (this->lods.empty())
+            this->lods.push_back({ 0, (uint32_t)this->indices.size(), 0.0f });
+        this->setupMesh();
+    }
+
+    // The GPU memory of the mesh belongs to the arena (see geometry_arena.h), so the default move constructor and
+    // move assignment are enough: they move the vectors and copy the position of the mesh in the arena
     // see:
-    // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
     // https://en.cppreference.com/w/cpp/language/move_constructor
     // https://en.cppreference.com/w/cpp/language/move_assignment
-    // https://www.learncpp.com/cpp-tutorial/15-1-intro-to-smart-pointers-move-semantics/
-    // https://www.learncpp.com/cpp-tutorial/15-3-move-constructors-and-move-assignment/
-    // Section 4.6 of the "A Tour in C++" book
+    Mesh(Mesh&& move) noexcept = default;
+    Mesh& operator=(Mesh&& move) noexcept = default;
 
-    // Move constructor
-    // The source object of a move constructor is not expected to be valid after the move.
-    // In our case it will no longer imply ownership of the GPU resources and its vectors will be empty.
-    Mesh(Mesh&& move) noexcept
-        // Calls move for both vectors, which internally consists of a simple pointer swap between the new instance and the source one.
-        : vertices(std::move(move.vertices)), indices(std::move(move.indices)),
-        VAO(move.VAO), VBO(move.VBO), EBO(move.EBO)
-    {
-        move.VAO = 0; // We *could* set VBO and EBO to 0 too,
-        // but since we bring all the 3 values around we can use just one of them to check ownership of the 3 resources.
-    }
+    //////////////////////////////////////////
 
-    // Move assignment
-    Mesh& operator=(Mesh&& move) noexcept
+    // rendering of mesh, at the requested level of detail (or the last available one)
+    void Draw(int lod = 0)
     {
-        // calls the function which will delete (if needed) the GPU resources for this instance
-        freeGPUresources();
-
-        if (move.VAO) // source instance has GPU resources
-        {
-            vertices = std::move(move.vertices);
-            indices = std::move(move.indices);
-            VAO = move.VAO;
-            VBO = move.VBO;
-            EBO = move.EBO;
-
-            move.VAO = 0;
-        }
-        else // source instance was already invalid
-        {
-            VAO = 0;
-        }
-        return *this;
+        const MeshLod& range = this->getLod(lod);
+        // the VAO of the arena is made "active" (if it is not already)
+        GeometryArena::Get(this->layout).Bind();
+        this->setDequantization();
+        // rendering of the mesh: its indices are relative to its first vertex in the arena
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.IndexCount, this->indexType, this->indexOffset(range), this->allocation.BaseVertex);
     }
 
-    // destructor
-    ~Mesh() noexcept
+    void DrawInstanced(int instances, int lod = 0)
     {
-        // calls the function which will delete (if needed) the GPU resources
-        freeGPUresources();
+        const MeshLod& range = this->getLod(lod);
+        // the VAO of the arena is made "active" (if it is not already)
+        GeometryArena::Get(this->layout).Bind();
+        this->setDequantization();
+        // rendering of the mesh: its indices are relative to its first vertex in the arena
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.IndexCount, this->indexType, this->indexOffset(range), instances, this->allocation.BaseVertex);
     }
 
-    //////////////////////////////////////////
-
-    // rendering of mesh
-    void Draw()
+    // the same draw of DrawInstanced, as a command for glDrawElementsIndirect (see draw_list.h)
+    DrawElementsIndirectCommand IndirectCommand(int lod, GLuint instances)
     {
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        // rendering of data in the VAO
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-        // VAO is "detached"
-        glBindVertexArray(0);
+        const MeshLod& range = this->getLod(lod);
+        GLuint firstIndex = (GLuint)((size_t)this->indexOffset(range) / (this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+        return { range.IndexCount, instances, firstIndex, this->allocation.BaseVertex, 0 };
     }
 
-    void DrawInstanced(int instances)
+    // rendering of the command at byte offset in the buffer bound to GL_DRAW_INDIRECT_BUFFER
+    void DrawIndirect(GLintptr offset)
     {
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        // rendering of data in the VAO
-        glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instances);
-        // VAO is "detached"
-        glBindVertexArray(0);
+        // the VAO of the arena is made "active" (if it is not already)
+        GeometryArena::Get(this->layout).Bind();
+        this->setDequantization();
+        glDrawElementsIndirect(GL_TRIANGLES, this->indexType, (const GLvoid*)offset);
     }
 
 private:
 
-    // VBO and EBO
-    GLuint VBO, EBO;
-
     //////////////////////////////////////////
-    // buffer objects\arrays are initialized
-    // a brief description of their role and how they are binded can be found at:
+    // the vertices are converted in the format of the layout and copied in the arena, with the indices
+    // a brief description of the role of the buffers can be found at:
     // https://learnopengl.com/#!Getting-started/Hello-Triangle
-    // (in different parts of the page), or here:
-    // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
     void setupMesh()
     {
-        // we create the buffers
-        glGenVertexArrays(1, &this->VAO);
-        glGenBuffers(1, &this->VBO);
-        glGenBuffers(1, &this->EBO);
-
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-        // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-        // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
-        // vertex positions
-        // these will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)"")
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-        // Normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-        // Tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
-        // Bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        GeometryArena& arena = GeometryArena::Get(this->layout);
+
+        // 16 bit indices halve the size of the indices, when all the vertices can be addressed
+        vector<GLushort> shortIndices;
+        const void* indexData = this->indices.data();
+        size_t indexBytes = this->indices.size() * sizeof(GLuint);
+        this->indexType = GL_UNSIGNED_INT;
+        if (this->vertices.size() < 65536)
+        {
+            this->indexType = GL_UNSIGNED_SHORT;
+            shortIndices.assign(this->indices.begin(), this->indices.end());
+            indexData = shortIndices.data();
+            indexBytes = shortIndices.size() * sizeof(GLushort);
+        }
+
+        if (this->layout == VertexLayout::Compact)
+        {
+            vector<CompactVertex> packed;
+            this->dequantization = packCompactVertices(this->vertices, packed);
+            this->allocation = arena.Allocate(packed.data(), packed.size(), indexData, indexBytes);
+        }
+        else
+        {
+            this->allocation = arena.Allocate(this->vertices.data(), this->vertices.size(), indexData, indexBytes);
+        }
     }
 
     //////////////////////////////////////////
+    const MeshLod& getLod(int lod)
+    {
+        return this->lods[min((size_t)max(lod, 0), this->lods.size() - 1)];
+    }
 
-    void freeGPUresources()
+    // byte offset in the EBO of the arena of the first index of a LOD
+    GLvoid* indexOffset(const MeshLod& range)
     {
-        // If VAO is 0, this instance of Mesh has been through a move, and no longer owns GPU resources,
-        // so there's no need for deleting.
-        if (VAO)
-        {
-            glDeleteVertexArrays(1, &this->VAO);
-            glDeleteBuffers(1, &this->VBO);
-            glDeleteBuffers(1, &this->EBO);
-        }
+        return (GLvoid*)(this->allocation.FirstIndexByte + range.IndexOffset * (this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+    }
+
+    //////////////////////////////////////////
+    // the dequantization transform is not part of the VAO state: it is set as the current value of two
+    // generic attributes, read by the vertex shader for every vertex of the draw call
+    void setDequantization()
+    {
+        glVertexAttrib3fv(POSITION_OFFSET_LOCATION, &this->dequantization.Offset[0]);
+        glVertexAttrib3fv(POSITION_SCALE_LOCATION, &this->dequantization.Scale[0]);
     }
 };
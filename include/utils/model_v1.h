@@ -34,6 +34,20 @@ using namespace std;
 // we include the Mesh class, which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
 #include <utils/mesh_v1.h>
 
+// generation of the levels of detail of the imported meshes
+#include <utils/mesh_simplifier.h>
+// reordering of triangles and vertices of the imported meshes
+#include <utils/mesh_optimizer.h>
+
+// binary cache of the processed meshes, to skip Assimp on warm starts
+#include <utils/mesh_cache.h>
+
+// post-processing applied by Assimp after the loading. They are part of the key of the mesh cache
+const unsigned int MODEL_POSTPROCESS_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
+
+// the overdraw sorting of the triangles is optional (it slightly worsens the vertex cache hits). It is part of the key of the mesh cache
+const bool MODEL_OPTIMIZE_OVERDRAW = true;
+
 /////////////////// MODEL class ///////////////////////
 class Model
 {
@@ -70,7 +84,16 @@ public:
     // because we are not writing a user-defined destructor.
     Model(const string& path)
     {
-        this->loadModel(path);
+        vector<MeshData> data = Import(path);
+        this->setupModel(data);
+    }
+
+    // constructor from already imported data (see Import)
+    // only the GPU buffers are created here, so it must be called on the thread owning the OpenGL context
+    // This constructor empties the source vector
+    Model(vector<MeshData>& data)
+    {
+        this->setupModel(data);
     }
 
     ~Model()
@@ -82,37 +105,113 @@ public:
     //////////////////////////////////////////
 
     // model rendering: calls rendering methods of each instance of Mesh class in the vector
-    void Draw()
+    // meshes with less LODs than the requested one draw their last LOD
+    void Draw(int lod = 0)
     {
         for(GLuint i = 0; i < this->meshes.size(); i++) {
-            this->meshes[i].Draw();
+            this->meshes[i].Draw(lod);
         }
     }
 
-    void DrawInstanced(int instances)
+    void DrawInstanced(int instances, int lod = 0)
     {
         for(GLuint i = 0; i < this->meshes.size(); i++) {
-            this->meshes[i].DrawInstanced(instances);
+            this->meshes[i].DrawInstanced(instances, lod);
         }
     }
 
     //////////////////////////////////////////
+    // number of LODs of the model: the maximum among its meshes
+    int LodCount()
+    {
+        return (int)this->lodErrors.size();
+    }
 
+    //////////////////////////////////////////
+    // object space error of each LOD (e.g. to select the LOD in a shader, like SelectLod)
+    const vector<float>& LodErrors()
+    {
+        return this->lodErrors;
+    }
 
-private:
+    //////////////////////////////////////////
+    // it chooses the coarsest LOD whose error, projected on the screen, is below maxPixelError.
+    // pixelsPerUnit is the size on the screen of an object space unit of the model, at its distance from the camera
+    int SelectLod(float pixelsPerUnit, float maxPixelError)
+    {
+        int lod = 0;
+        while (lod + 1 < this->LodCount() && this->lodErrors[lod + 1] * pixelsPerUnit < maxPixelError)
+            lod++;
+        return lod;
+    }
 
     //////////////////////////////////////////
-    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
-    void loadModel(string path)
+    // CPU side of the loading: cache lookup or Assimp import, and conversion of the vertices
+    // It does not use OpenGL, so it can run on a worker thread (each call uses its own Assimp importer)
+    static vector<MeshData> Import(const string& path)
     {
         cout << "Loading model " << path << endl;
+
+        // if a valid cache of the processed meshes exists, we skip Assimp
+        vector<MeshData> data;
+        MeshCache cache(path, MODEL_POSTPROCESS_FLAGS, MODEL_OPTIMIZE_OVERDRAW ? 1 : 0);
+        if (cache.Load(data))
+        {
+            cout << "Loaded model " << path << " from cache" << endl;
+        }
+        else
+        {
+            importModel(path, data);
+            // the LODs and the optimized meshes are cached, so their generation is only paid once
+            for (MeshData& mesh : data)
+            {
+                generateLods(mesh);
+                optimizeMesh(mesh, MODEL_OPTIMIZE_OVERDRAW);
+            }
+            cache.Save(data);
+        }
+
+        return data;
+    }
+
+    //////////////////////////////////////////
+
+
+private:
+
+    // object space error of each LOD (see mesh_simplifier.h)
+    vector<float> lodErrors;
+
+    //////////////////////////////////////////
+    // GPU side of the loading: creation of the buffers of each mesh
+    void setupModel(vector<MeshData>& data)
+    {
+        // the error of a LOD of the model is the maximum error of the LODs of its meshes
+        // (meshes with less LODs keep using their last one)
+        size_t lodCount = 1;
+        for (MeshData& mesh : data)
+            lodCount = max(lodCount, mesh.lods.size());
+        this->lodErrors.assign(lodCount, 0.0f);
+        for (MeshData& mesh : data)
+        {
+            for (size_t lod = 0; lod < lodCount && !mesh.lods.empty(); lod++)
+                this->lodErrors[lod] = max(this->lodErrors[lod], mesh.lods[min(lod, mesh.lods.size() - 1)].Error);
+            this->meshes.emplace_back(mesh);
+        }
+        data.clear();
+    }
+
+    //////////////////////////////////////////
+    // import of the model using Assimp library. Nodes are processed to build a vector of processed meshes
+    static void importModel(const string& path, vector<MeshData>& data)
+    {
         // loading using Assimp
         // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
         // Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
         // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
         // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_POSTPROCESS_FLAGS);
 
         // check for errors (see comment above)
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
@@ -122,13 +221,13 @@ private:
         }
 
         // we start the recursive processing of nodes in the Assimp data structure
-        this->processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, data);
     }
 
     //////////////////////////////////////////
 
     // Recursive processing of nodes of Assimp data structure
-    void processNode(aiNode* node, const aiScene* scene)
+    static void processNode(aiNode* node, const aiScene* scene, vector<MeshData>& data)
     {
 
         cout << "Processing node " << node << endl;
@@ -139,30 +238,31 @@ private:
             // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             // we start processing of the Assimp mesh using processMesh method.
-            // the result (an istance of the Mesh class) is added to the vector
+            // the result (the vertices and indices of the mesh) is added to the vector
             // we use emplace_back instead as push_back, so to have the instance created directly in the 
             // vector memory, without the creation of a temp copy.
             // https://en.cppreference.com/w/cpp/container/vector/emplace_back 
             cout << "Processing mesh " << i << endl;
-            this->meshes.emplace_back(processMesh(mesh));
+            data.emplace_back(processMesh(mesh));
         }
         // we then recursively process each of the children nodes
         for(GLuint i = 0; i < node->mNumChildren; i++)
         {
-            this->processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
     //////////////////////////////////////////
 
-    // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
-    // = we create and allocate the buffers used to send mesh data to the GPU
-    Mesh processMesh(aiMesh* mesh)
+    // Processing of the Assimp mesh in order to obtain the data of an "OpenGL mesh"
+    // = the vertices and indices later used to create and allocate the buffers used to send mesh data to the GPU
+    static MeshData processMesh(aiMesh* mesh)
     {
         // data structures for vertices and indices of vertices (for faces)
-        vector<Vertex> vertices;
-        vector<GLuint> indices;
+        MeshData data;
+        vector<Vertex>& vertices = data.vertices;
+        vector<GLuint>& indices = data.indices;
 
         for(GLuint i = 0; i < mesh->mNumVertices; i++)
         {
@@ -218,7 +318,7 @@ private:
                 indices.push_back(face.mIndices[j]);
         }
 
-        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices);
+        // we return the vertices and faces data structures we have created above.
+        return data;
     }
 };
@@ -0,0 +1,147 @@
+/*
+ProgramCache class
+- binary cache of the linked programs (glGetProgramBinary / glProgramBinary), stored next to the vertex shader,
+  one file for each variant (e.g. base.vert.0123456789abcdef.program)
+- the cache is keyed by a hash of the sources of all the stages (with the defines of the variant) and of the vendor,
+  renderer and version strings of the driver: the binaries are in a format of the driver, so after an update of the
+  driver (or on another GPU) the cache is ignored, and the program is compiled and saved again
+- on warm starts a program is ready with a single glProgramBinary, without compiling and linking its shaders.
+  The driver can still reject a binary (e.g. a different version with the same strings): Load returns false
+  and the program is compiled as usual
+
+Cache layout:
+header | binary of the program
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <utils/hash.h>
+
+// to be incremented every time the layout of the file changes
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Format;
+    uint32_t Length;
+};
+
+class ProgramCache
+{
+public:
+    ProgramCache() = default;
+
+    // the paths of the stages and the defines name the file of the variant, the sources (with the defines) are its key
+    ProgramCache(const vector<string>& paths, const vector<string>& defines, const vector<string>& sources)
+    {
+        uint64_t variant = FNV_OFFSET_BASIS;
+        for (const string& path : paths)
+            variant = hashBytes(path.c_str(), path.size() + 1, variant);
+        for (const string& define : defines)
+            variant = hashBytes(define.c_str(), define.size() + 1, variant);
+        char name[32];
+        snprintf(name, sizeof(name), ".%016llx.program", (unsigned long long)variant);
+        this->cachePath = paths[0] + name;
+
+        this->key = computeKey(sources);
+    }
+
+    //////////////////////////////////////////
+    // it loads the cached binary in the program. It returns false if the cache is missing, stale or rejected by the driver
+    bool Load(GLuint program)
+    {
+        if (!IsSupported())
+            return false;
+
+        ifstream file(this->cachePath, ios::binary);
+        if (!file.is_open())
+            return false;
+
+        ProgramCacheHeader header;
+        file.read((char*)&header, sizeof(header));
+        if (!file || memcmp(header.Magic, "RTPB", 4) != 0 || header.Version != PROGRAM_CACHE_VERSION || header.Key != this->key)
+            return false;
+
+        vector<char> binary(header.Length);
+        file.read(binary.data(), binary.size());
+        if (!file)
+            return false;
+
+        glProgramBinary(program, header.Format, binary.data(), header.Length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    //////////////////////////////////////////
+    // it writes the binary of a linked program (linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT)
+    void Save(GLuint program)
+    {
+        if (!IsSupported())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        ofstream file(this->cachePath, ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            cout << "WARNING::PROGRAM-CACHE:: cannot write " << this->cachePath << endl;
+            return;
+        }
+        ProgramCacheHeader header = { { 'R', 'T', 'P', 'B' }, PROGRAM_CACHE_VERSION, this->key, format, (uint32_t)length };
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+    }
+
+    // a driver may support no binary format at all (e.g. some software renderers)
+    static bool IsSupported()
+    {
+        static GLint formats = -1;
+        if (formats < 0)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+private:
+    string cachePath;
+    uint64_t key = 0;
+
+    //////////////////////////////////////////
+    // hash of the sources, combined with the strings of the driver which produces the binaries
+    uint64_t computeKey(const vector<string>& sources)
+    {
+        uint64_t hash = FNV_OFFSET_BASIS;
+        for (const string& source : sources)
+            hash = hashBytes(source.c_str(), source.size() + 1, hash);
+
+        GLenum strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : strings)
+        {
+            const char* value = (const char*)glGetString(name);
+            if (value)
+                hash = hashBytes(value, strlen(value) + 1, hash);
+        }
+        hash = hashValue(PROGRAM_CACHE_VERSION, hash);
+
+        return hash ? hash : 1;
+    }
+};
@@ -0,0 +1,67 @@
+//--- RENDER QUEUE: THE DRAWS OF A FRAME ARE SUBMITTED AS ITEMS WITH A 64 BIT SORT KEY, SORTED, AND EXECUTED IN ORDER.
+//--- THE KEY HAS THE MOST EXPENSIVE STATE IN ITS HIGH BITS, SO THE DRAWS WITH THE SAME STATE END UP NEXT TO EACH OTHER
+//--- AND THE STATE IS SET ONLY WHEN IT CHANGES:
+//---   | PASS 4 | PROGRAM 6 | DEPTH 24 | MATERIAL 22 | MESH 8 |
+//--- THE MATERIALS ARE LAYERS OF TEXTURE ARRAYS THAT ARE ALWAYS BOUND (SEE material_arrays.h): CHANGING MATERIAL IS ONLY
+//--- A UNIFORM, SO THE DEPTH COMES BEFORE IT, AND THE OPAQUE DRAWS OF A PROGRAM GO FRONT TO BACK (EARLY Z REJECTS THE
+//--- HIDDEN FRAGMENTS). THE QUEUE ONLY SORTS: THE ITEM CARRIES THE INDEX OF THE DRAW IN AN ARRAY OF THE APP,
+//--- AND THE APP EXECUTES IT
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PROGRAM_BITS 6
+#define RENDER_KEY_DEPTH_BITS 24
+#define RENDER_KEY_MATERIAL_BITS 22
+#define RENDER_KEY_MESH_BITS 8
+
+struct RenderItem {
+    uint64_t Key;
+    uint32_t Draw;
+
+    bool operator<(const RenderItem& other) const {
+        return Key < other.Key;
+    }
+};
+
+class RenderQueue {
+    public:
+
+    //--- depth IS THE DISTANCE FROM THE CAMERA, QUANTIZED IN [0, maxDepth]
+    static uint64_t Key(uint32_t pass, uint32_t program, float depth, float maxDepth, uint32_t material, uint32_t mesh) {
+        float normalized = std::min(std::max(depth / maxDepth, 0.0f), 1.0f);
+        uint64_t quantized = (uint64_t)(normalized * (float)mask(RENDER_KEY_DEPTH_BITS));
+        uint64_t key = pass & mask(RENDER_KEY_PASS_BITS);
+        key = (key << RENDER_KEY_PROGRAM_BITS) | (program & mask(RENDER_KEY_PROGRAM_BITS));
+        key = (key << RENDER_KEY_DEPTH_BITS) | quantized;
+        key = (key << RENDER_KEY_MATERIAL_BITS) | (material & mask(RENDER_KEY_MATERIAL_BITS));
+        key = (key << RENDER_KEY_MESH_BITS) | (mesh & mask(RENDER_KEY_MESH_BITS));
+        return key;
+    }
+
+    void Clear() {
+        items.clear();
+    }
+
+    void Push(uint64_t key, uint32_t draw) {
+        items.push_back({ key, draw });
+    }
+
+    //--- THE ITEMS IN EXECUTION ORDER. EQUAL KEYS KEEP THE ORDER OF SUBMISSION
+    const std::vector<RenderItem>& Sort() {
+        std::stable_sort(items.begin(), items.end());
+        return items;
+    }
+
+    private:
+
+    std::vector<RenderItem> items;
+
+    static uint64_t mask(int bits) {
+        return (1ull << bits) - 1;
+    }
+};
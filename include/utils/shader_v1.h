@@ -1,6 +1,15 @@
 /*
 Shader class - v1
 - loading Shader source code, Shader Program creation
+- reflection of the program after the link: the locations of the active uniforms, the indices of the uniform blocks
+  and of the subroutines are read once, so the rendering code asks for them at initialization and keeps the handles,
+  without string lookups (glGetUniformLocation, glGetSubroutineIndex) during the frame
+- variants of the same sources: a list of defines is inserted after the #version line of every stage,
+  and ShaderPermutations keeps one program for each set of defines (see the end of the file)
+- the linked programs are saved with glGetProgramBinary and loaded back on the next launches (see program_cache.h)
+- on a cache miss the constructor only submits the compilation and the link: their status is read at the first
+  use of the program (Use, Uniform, ...). If all the programs are created before using any of them, a driver
+  with parallel compilation (KHR_parallel_shader_compile) compiles them at the same time
 
 N.B. ) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/shader.h
 
@@ -20,6 +29,20 @@ using namespace std;
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <utils/program_cache.h>
+#include <utils/gl_state.h>
+
+// handle of a subroutine of a stage of the program
+struct ShaderSubroutine {
+    GLenum Stage = GL_VERTEX_SHADER;
+    GLuint Index = GL_INVALID_INDEX;
+};
 
 /////////////////// SHADER class ///////////////////////
 class Shader
@@ -27,7 +50,7 @@ class Shader
 public:
     GLuint Program;
 
-    Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const vector<string>& defines = vector<string>())
     {
         // Step 1: we retrieve shaders source code from provided filepaths
         string vertexCode;
@@ -59,41 +82,16 @@ public:
             cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
         }
 
-        // Convert strings to char pointers
-        const GLchar* vShaderCode = vertexCode.c_str();
-        const GLchar * fShaderCode = fragmentCode.c_str();
-
-        // Step 2: we compile the shaders
-        GLuint vertex, fragment;
+        // we add the defines of the variant
+        vertexCode = addDefines(vertexCode, defines);
+        fragmentCode = addDefines(fragmentCode, defines);
 
-        // Vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // check compilation errors
-        checkCompileErrors(vertex, "VERTEX");
-
-        // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // check compilation errors
-        checkCompileErrors(fragment, "FRAGMENT");
-
-        // Step 3: Shader Program creation
-        this->Program = glCreateProgram();
-        glAttachShader(this->Program, vertex);
-        glAttachShader(this->Program, fragment);
-        glLinkProgram(this->Program);
-        // check linking errors
-        checkCompileErrors(this->Program, "PROGRAM");
-
-        // Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        // Step 2: the program is loaded from the cache, or its shaders are compiled and linked (see build)
+        this->cache = ProgramCache({ vertexPath, fragmentPath }, defines, { vertexCode, fragmentCode });
+        this->build({ { GL_VERTEX_SHADER, vertexCode }, { GL_FRAGMENT_SHADER, fragmentCode } });
     }
     
-    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath)
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath, const vector<string>& defines = vector<string>())
     {
         // Step 1: we retrieve shaders source code from provided filepaths
         string vertexCode;
@@ -134,59 +132,248 @@ public:
             cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
         }
 
-        // Convert strings to char pointers
-        const GLchar* vShaderCode = vertexCode.c_str();
-        const GLchar * fShaderCode = fragmentCode.c_str();
-        const GLchar * gShaderCode = geometryCode.c_str();
-
-        // Step 2: we compile the shaders
-        GLuint vertex, fragment, geometry;
-
-        // Vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // check compilation errors
-        checkCompileErrors(vertex, "VERTEX");
-
-        // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // check compilation errors
-        checkCompileErrors(fragment, "FRAGMENT");
-
-        // Geometry Shader
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &gShaderCode, NULL);
-        glCompileShader(geometry);
-        // check compilation errors
-        checkCompileErrors(geometry, "GEOMETRY");
-
-        // Step 3: Shader Program creation
-        this->Program = glCreateProgram();
-        glAttachShader(this->Program, vertex);
-        glAttachShader(this->Program, fragment);
-        glAttachShader(this->Program, geometry);
-        glLinkProgram(this->Program);
-        // check linking errors
-        checkCompileErrors(this->Program, "PROGRAM");
+        // we add the defines of the variant
+        vertexCode = addDefines(vertexCode, defines);
+        fragmentCode = addDefines(fragmentCode, defines);
+        geometryCode = addDefines(geometryCode, defines);
 
-        // Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        glDeleteShader(geometry);
+        // Step 2: the program is loaded from the cache, or its shaders are compiled and linked (see build)
+        this->cache = ProgramCache({ vertexPath, fragmentPath, geometryPath }, defines, { vertexCode, fragmentCode, geometryCode });
+        this->build({ { GL_VERTEX_SHADER, vertexCode }, { GL_FRAGMENT_SHADER, fragmentCode }, { GL_GEOMETRY_SHADER, geometryCode } });
+    }
+
+    // program without fragment stage, for transform feedback: the varyings are captured (interleaved) in the buffer
+    // bound to GL_TRANSFORM_FEEDBACK_BUFFER. The draws are done with GL_RASTERIZER_DISCARD enabled
+    Shader(const GLchar* vertexPath, const GLchar* geometryPath, const vector<string>& varyings, const vector<string>& defines)
+    {
+        // Step 1: we retrieve shaders source code from provided filepaths, and we add the defines of the variant
+        string vertexCode = addDefines(readSource(vertexPath), defines);
+        string geometryCode = addDefines(readSource(geometryPath), defines);
+
+        // Step 2: the captured varyings are part of the link, so they are part of the key of the cache too
+        string captured;
+        for (const string& varying : varyings)
+            captured += varying + ";";
+        this->varyings = varyings;
+        this->cache = ProgramCache({ vertexPath, geometryPath }, defines, { vertexCode, geometryCode, captured });
+        this->build({ { GL_VERTEX_SHADER, vertexCode }, { GL_GEOMETRY_SHADER, geometryCode } });
     }
 
     //////////////////////////////////////////
 
     // We activate the Shader Program as part of the current rendering process
-    void Use() { glUseProgram(this->Program); }
+    // (the call is skipped if the program is already active, see gl_state.h)
+    void Use()
+    {
+        this->finish();
+        GLState::Get().UseProgram(this->Program);
+    }
 
     // We delete the Shader Program when application closes
-    void Delete() { glDeleteProgram(this->Program); }
+    void Delete() { GLState::Get().DeleteProgram(this->Program); }
+
+    //////////////////////////////////////////
+
+    // location of an active uniform (the name of an array without "[0]"), -1 if the uniform is not used by the program
+    GLint Uniform(const string& name)
+    {
+        this->finish();
+        auto uniform = this->uniforms.find(name);
+        return uniform != this->uniforms.end() ? uniform->second : -1;
+    }
+
+    // index of a uniform block, GL_INVALID_INDEX if it is not used by the program
+    GLuint UniformBlock(const string& name)
+    {
+        this->finish();
+        auto block = this->blocks.find(name);
+        return block != this->blocks.end() ? block->second : GL_INVALID_INDEX;
+    }
+
+    // handle of a subroutine of a stage
+    ShaderSubroutine Subroutine(GLenum stage, const string& name)
+    {
+        this->finish();
+        ShaderSubroutine subroutine;
+        subroutine.Stage = stage;
+        auto found = this->subroutines.find(make_pair(stage, name));
+        if (found != this->subroutines.end())
+            subroutine.Index = found->second;
+        else
+            cout << "| ERROR::::SHADER-SUBROUTINE-NOT-FOUND: " << name << " |" << endl;
+        return subroutine;
+    }
+
+    // We select the subroutine for its stage. The stages of our shaders have a single subroutine uniform.
+    // N.B.) the selection is not part of the state of the program: it is lost at every Use
+    void Select(const ShaderSubroutine& subroutine) const
+    {
+        glUniformSubroutinesuiv(subroutine.Stage, 1, &subroutine.Index);
+    }
 
 private:
+    unordered_map<string, GLint> uniforms;
+    unordered_map<string, GLuint> blocks;
+    map<pair<GLenum, string>, GLuint> subroutines;
+    // binary of the program on disk
+    ProgramCache cache;
+    // shaders compiled and linked, whose status has not been read yet (see finish)
+    vector<pair<GLuint, GLenum>> pending;
+    // outputs captured by transform feedback
+    vector<string> varyings;
+
+    //////////////////////////////////////////
+
+    // source code of a stage
+    static string readSource(const GLchar* path)
+    {
+        ifstream file;
+        file.exceptions(ifstream::failbit | ifstream::badbit);
+        try
+        {
+            file.open(path);
+            stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            return stream.str();
+        }
+        catch (const ifstream::failure&)
+        {
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
+        }
+        return "";
+    }
+
+    //////////////////////////////////////////
+
+    // the defines are inserted after the #version line, which must be the first line of the source
+    static string addDefines(const string& code, const vector<string>& defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t line = code.find('\n');
+        if (line == string::npos)
+            return code;
+        string result = code.substr(0, line + 1);
+        for (const string& define : defines)
+            result += "#define " + define + "\n";
+        // the line numbers of the errors refer to the source file
+        result += "#line 2\n";
+        return result + code.substr(line + 1);
+    }
+
+    //////////////////////////////////////////
+
+    // Step 2: the cached binary is used if the driver accepts it. Otherwise the shaders are compiled and linked,
+    // but their status is not read: a glGetShaderiv/glGetProgramiv right after the submission would wait for
+    // the driver, while the other programs could be compiled in the meantime
+    void build(const vector<pair<GLenum, string>>& stages)
+    {
+        this->Program = glCreateProgram();
+        if (this->cache.Load(this->Program))
+        {
+            this->reflect();
+            return;
+        }
+        // a rejected binary leaves the program in an unknown state, we start from a new one
+        glDeleteProgram(this->Program);
+        this->Program = glCreateProgram();
+
+        for (const pair<GLenum, string>& stage : stages)
+        {
+            const GLchar* code = stage.second.c_str();
+            GLuint shader = glCreateShader(stage.first);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(this->Program, shader);
+            this->pending.push_back(make_pair(shader, stage.first));
+        }
+        // the captured varyings must be declared before the link
+        if (!this->varyings.empty())
+        {
+            vector<const GLchar*> names;
+            for (const string& varying : this->varyings)
+                names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(this->Program, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        // the binary can be read only if it is requested before the link
+        glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(this->Program);
+    }
+
+    // Step 3: at the first use of the program we check the link (and the compilation of the shaders, if it failed),
+    // the linked program is saved in the cache and reflected
+    void finish()
+    {
+        if (this->pending.empty())
+            return;
+
+        GLint success;
+        glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
+        if (success)
+            this->cache.Save(this->Program);
+        else
+        {
+            for (const pair<GLuint, GLenum>& shader : this->pending)
+                checkCompileErrors(shader.first, shader.second == GL_VERTEX_SHADER ? "VERTEX" : shader.second == GL_GEOMETRY_SHADER ? "GEOMETRY" : "FRAGMENT");
+            checkCompileErrors(this->Program, "PROGRAM");
+        }
+        // we read the uniforms, the uniform blocks and the subroutines of the linked program
+        this->reflect();
+
+        // Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
+        for (const pair<GLuint, GLenum>& shader : this->pending)
+            glDeleteShader(shader.first);
+        this->pending.clear();
+    }
+
+    //////////////////////////////////////////
+
+    // introspection of the linked program
+    void reflect()
+    {
+        GLchar name[256];
+        GLsizei length;
+
+        GLint count = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(this->Program, i, sizeof(name), &length, &size, &type, name);
+            GLint location = glGetUniformLocation(this->Program, name);
+            // the members of the uniform blocks have no location
+            if (location < 0)
+                continue;
+            string uniform(name, length);
+            // arrays are listed as "name[0]"
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+                uniform.resize(uniform.size() - 3);
+            this->uniforms[uniform] = location;
+        }
+
+        count = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            glGetActiveUniformBlockName(this->Program, i, sizeof(name), &length, name);
+            this->blocks[string(name, length)] = i;
+        }
+
+        GLenum stages[] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+        for (GLenum stage : stages)
+        {
+            count = 0;
+            glGetProgramStageiv(this->Program, stage, GL_ACTIVE_SUBROUTINES, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                glGetActiveSubroutineName(this->Program, stage, i, sizeof(name), &length, name);
+                this->subroutines[make_pair(stage, string(name, length))] = i;
+            }
+        }
+    }
+
     //////////////////////////////////////////
 
     // Check compilation and linking errors
@@ -214,3 +401,45 @@ private:
 		}
 	}
 };
+
+/////////////////// SHADER PERMUTATIONS class ///////////////////////
+// programs compiled from the same sources with different sets of defines, instead of choosing the behaviour
+// at run time (e.g. with subroutines, which must be selected again after every glUseProgram).
+// Each variant is compiled the first time it is requested, and cached with the (sorted) defines as key
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(const GLchar* vertexPath, const GLchar* fragmentPath)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+    ShaderPermutations(const ShaderPermutations& copy) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+    // program of the variant with the given defines
+    Shader& Get(vector<string> defines)
+    {
+        sort(defines.begin(), defines.end());
+        string key;
+        for (const string& define : defines)
+            key += define + ";";
+
+        unique_ptr<Shader>& program = this->programs[key];
+        if (!program)
+            program.reset(new Shader(this->vertexPath.c_str(), this->fragmentPath.c_str(), defines));
+        return *program;
+    }
+
+    // We delete all the variants when application closes
+    void Delete()
+    {
+        for (auto& program : this->programs)
+            program.second->Delete();
+        this->programs.clear();
+    }
+
+private:
+    string vertexPath;
+    string fragmentPath;
+    map<string, unique_ptr<Shader>> programs;
+};
+
@@ -0,0 +1,141 @@
+//--- RING BUFFER FOR DATA WRITTEN EVERY FRAME (E.G. INSTANCE DATA)
+//--- EACH Write MAPS A NEW RANGE OF THE BUFFER WITH GL_MAP_UNSYNCHRONIZED_BIT: THE DRIVER DOESN'T WAIT FOR THE GPU
+//--- AND DOESN'T ALLOCATE NEW MEMORY. THE APP SYNCHRONIZES ITSELF: EndFrame PUTS A FENCE AFTER THE RANGES WRITTEN
+//--- IN THE FRAME, AND A RANGE IS WRITTEN AGAIN ONLY AFTER THE FENCES OF ITS PREVIOUS USES ARE SIGNALED.
+//--- THE BUFFER IS SIZED FOR A FEW FRAMES OF DATA, SO THE WAIT NORMALLY NEVER HAPPENS.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+#include <utils/gl_state.h>
+
+class StreamBuffer {
+    public:
+
+    StreamBuffer(GLenum target, GLsizeiptr size) : target(target), size(size) {
+        //--- UNIFORM BUFFERS CAN ONLY BE BOUND AT OFFSETS MULTIPLE OF THE ALIGNMENT OF THE DRIVER
+        GLint uniformAlignment = 16;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        alignment = target == GL_UNIFORM_BUFFER ? max(uniformAlignment, 16) : 16;
+
+        glGenBuffers(1, &buffer);
+        GLState::Get().BindBuffer(target, buffer);
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+        GLState::Get().BindBuffer(target, 0);
+    }
+
+    StreamBuffer(const StreamBuffer& copy) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    //--- LIKE Shader::Delete, TO BE CALLED WHILE THE CONTEXT IS STILL ALIVE
+    void Delete() {
+        for(Fence& fence : fences) {
+            glDeleteSync(fence.sync);
+        }
+        fences.clear();
+        GLState::Get().DeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    //--- COPIES THE DATA IN THE NEXT FREE RANGE OF THE BUFFER AND RETURNS ITS OFFSET
+    GLintptr Write(const void* data, GLsizeiptr bytes) {
+        GLintptr offset = (head + alignment - 1) / alignment * alignment;
+        if(offset + bytes > size) {
+            offset = 0;
+        }
+        waitFor(offset, offset + bytes);
+
+        //--- THE BUFFER STAYS BOUND: THE NEXT Write OF THE FRAME DOESN'T BIND IT AGAIN
+        GLState::Get().BindBuffer(target, buffer);
+        void* destination = glMapBufferRange(target, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if(destination) {
+            memcpy(destination, data, bytes);
+            glUnmapBuffer(target);
+        } else {
+            //--- A MAPPING CAN FAIL (E.G. bytes == 0): THE SAME RANGE IS WRITTEN WITH A COPY
+            glBufferSubData(target, offset, bytes, data);
+        }
+
+        frameStart = min(frameStart, offset);
+        frameEnd = max(frameEnd, offset + bytes);
+        head = offset + bytes;
+        return offset;
+    }
+
+    //--- TO BE CALLED ONCE PER FRAME, AFTER THE DRAW CALLS READING THE RANGES WRITTEN IN THE FRAME
+    void EndFrame() {
+        if(frameEnd > frameStart) {
+            fences.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameStart, frameEnd });
+        }
+        frameStart = size;
+        frameEnd = 0;
+    }
+
+    GLuint Buffer() {
+        return buffer;
+    }
+
+    GLsizeiptr Size() {
+        return size;
+    }
+
+    //--- REALLOCATES THE BUFFER (KEEPING ITS NAME) WHEN THE DATA OF A FRAME GROWS. IT WAITS FOR ALL THE FRAMES
+    //--- STILL USING THE OLD STORE, SO IT'S MEANT FOR RARE CHANGES (E.G. A BIGGER MAP), NOT FOR EVERY FRAME
+    void Resize(GLsizeiptr newSize) {
+        waitFor(0, size);
+        size = newSize;
+        head = 0;
+        frameStart = size;
+        frameEnd = 0;
+        GLState::Get().BindBuffer(target, buffer);
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+        GLState::Get().BindBuffer(target, 0);
+    }
+
+    private:
+
+    struct Fence {
+        GLsync sync;
+        GLintptr start;
+        GLintptr end;
+    };
+
+    GLenum target;
+    GLsizeiptr size;
+    GLint alignment;
+    GLuint buffer = 0;
+    GLintptr head = 0;
+    //--- RANGE WRITTEN IN THE CURRENT FRAME (A WRAPPED FRAME COVERS THE WHOLE BUFFER, WHICH IS SAFE)
+    GLintptr frameStart = PTRDIFF_MAX;
+    GLintptr frameEnd = 0;
+    std::deque<Fence> fences;
+
+    //--- WAITS FOR THE GPU TO FINISH READING THE RANGES OVERLAPPING [start, end)
+    void waitFor(GLintptr start, GLintptr end) {
+        //--- FENCES ARE SIGNALED IN ORDER: WAITING FOR THE LAST OVERLAPPING ONE IS ENOUGH
+        int last = -1;
+        for(size_t i = 0; i < fences.size(); i++) {
+            if(fences[i].start < end && start < fences[i].end) {
+                last = i;
+            }
+        }
+        if(last >= 0) {
+            GLenum result = glClientWaitSync(fences[last].sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            while(result == GL_TIMEOUT_EXPIRED) {
+                result = glClientWaitSync(fences[last].sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            for(int i = 0; i <= last; i++) {
+                glDeleteSync(fences.front().sync);
+                fences.pop_front();
+            }
+        }
+        //--- FENCES ALREADY SIGNALED ARE RELEASED WITHOUT WAITING
+        while(!fences.empty() && glClientWaitSync(fences.front().sync, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            glDeleteSync(fences.front().sync);
+            fences.pop_front();
+        }
+    }
+};
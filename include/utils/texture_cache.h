@@ -0,0 +1,425 @@
+/*
+TextureCache class
+- bake step for the textures of the scene: the decoded image is reduced to a full mip chain (box filter),
+  each level is compressed to BC1 (DXT1, 4 bits per pixel) and the result is written in a DDS file
+  next to the source image (e.g. ../textures/house.jpg.dds)
+- on the following launches the DDS is read and its levels are uploaded as they are, so there is
+  no JPEG decoding and no glGenerateMipmap at startup, and the texture takes 1/8 of the memory of an RGBA8 one
+- the DDS stores, in its reserved fields, the hash of the source image and the version of the baker:
+  if the image changes, the texture is baked again
+
+Read and Bake do not use OpenGL, so they can run on a worker thread. Upload must be called on the context thread, it copies the levels through the staging buffers of an UploadPool.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <utils/gl_state.h>
+#include <utils/hash.h>
+#include <utils/upload_pool.h>
+
+// BC1 is part of EXT_texture_compression_s3tc, not of the core profile used to generate glad
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// to be incremented every time the baker changes its output
+#define TEXTURE_CACHE_VERSION 1
+
+// DDS file layout, see https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+struct DDSPixelFormat {
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t FourCC;
+    uint32_t RGBBitCount;
+    uint32_t RBitMask;
+    uint32_t GBitMask;
+    uint32_t BBitMask;
+    uint32_t ABitMask;
+};
+
+struct DDSHeader {
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t Height;
+    uint32_t Width;
+    uint32_t PitchOrLinearSize;
+    uint32_t Depth;
+    uint32_t MipMapCount;
+    uint32_t Reserved1[11];
+    DDSPixelFormat PixelFormat;
+    uint32_t Caps;
+    uint32_t Caps2;
+    uint32_t Caps3;
+    uint32_t Caps4;
+    uint32_t Reserved2;
+};
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC_DXT1 0x31545844 // "DXT1"
+#define DDS_BAKER_TAG 0x50475452 // "RTGP", marks the files written by this class
+
+// compressed texture with all its mip levels, level 0 first
+struct CompressedTexture {
+    int Width = 0;
+    int Height = 0;
+    vector<vector<uint8_t>> Levels;
+};
+
+class TextureCache
+{
+public:
+    TextureCache(const string& sourcePath)
+        : cachePath(sourcePath + ".dds")
+    {
+        this->key = hashFile(sourcePath);
+    }
+
+    //////////////////////////////////////////
+    // it reads the baked texture. It returns false if it is missing or stale
+    bool Read(CompressedTexture& texture)
+    {
+        if (!this->key)
+            return false;
+
+        ifstream file(this->cachePath, ios::binary | ios::ate);
+        if (!file.is_open())
+            return false;
+        uint64_t fileSize = (uint64_t)file.tellg();
+        file.seekg(0);
+
+        uint32_t magic;
+        DDSHeader header;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&header, sizeof(header));
+        if (!file || magic != DDS_MAGIC || header.PixelFormat.FourCC != DDS_FOURCC_DXT1)
+            return false;
+        if (header.Reserved1[0] != DDS_BAKER_TAG || header.Reserved1[1] != TEXTURE_CACHE_VERSION
+            || header.Reserved1[2] != (uint32_t)this->key || header.Reserved1[3] != (uint32_t)(this->key >> 32))
+            return false;
+
+        // the sizes of the header are checked before allocating the levels: a broken file is baked again
+        if (!validLevels(header, fileSize - sizeof(magic) - sizeof(header)))
+            return false;
+
+        texture.Width = header.Width;
+        texture.Height = header.Height;
+        texture.Levels.resize(header.MipMapCount);
+        int w = texture.Width;
+        int h = texture.Height;
+        for (vector<uint8_t>& level : texture.Levels)
+        {
+            level.resize(BlocksSize(w, h));
+            file.read((char*)level.data(), level.size());
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        return (bool)file;
+    }
+
+    //////////////////////////////////////////
+    // it builds the mip chain of an RGB image, compresses it and writes the DDS file
+    void Bake(const unsigned char* rgb, int width, int height, CompressedTexture& texture)
+    {
+        texture.Width = width;
+        texture.Height = height;
+        texture.Levels.clear();
+
+        vector<uint8_t> level(rgb, rgb + width * height * 3);
+        int w = width;
+        int h = height;
+        while (true)
+        {
+            texture.Levels.push_back(compressLevel(level, w, h));
+            if (w == 1 && h == 1)
+                break;
+            level = downsample(level, w, h);
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+
+        if (this->key)
+            write(texture);
+    }
+
+    //////////////////////////////////////////
+    // it creates the OpenGL texture, uploading every level of the chain through the staging buffers of the pool
+    static GLuint Upload(const CompressedTexture& texture, UploadPool& pool)
+    {
+        GLuint textureImage;
+        glGenTextures(1, &textureImage);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureImage);
+
+        int w = texture.Width;
+        int h = texture.Height;
+        for (size_t i = 0; i < texture.Levels.size(); i++)
+        {
+            const vector<uint8_t>& blocks = texture.Levels[i];
+            pool.Upload(blocks.data(), blocks.size(), [&](const GLvoid* pixels) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0, blocks.size(), pixels);
+            });
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.Levels.size() - 1);
+
+        return textureImage;
+    }
+
+    //////////////////////////////////////////
+    // BC1 is not guaranteed by the core profile, so we check the extension before using the cache
+    static bool IsSupported()
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // size in bytes of a BC1 level: 8 bytes for each 4x4 block
+    static size_t BlocksSize(int width, int height)
+    {
+        return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+    }
+
+private:
+    string cachePath;
+    // 0 if the source image cannot be read
+    uint64_t key;
+
+    //////////////////////////////////////////
+    // at least one level and at most the full chain, the first one of the size of the blocks of the image,
+    // and exactly the bytes of the levels after the header
+    static bool validLevels(const DDSHeader& header, uint64_t levelsBytes)
+    {
+        if (header.Width == 0 || header.Height == 0 || header.Width > 65536 || header.Height > 65536)
+            return false;
+        if (header.PitchOrLinearSize != BlocksSize(header.Width, header.Height))
+            return false;
+
+        uint32_t chainLength = 1;
+        for (uint32_t size = max(header.Width, header.Height); size > 1; size /= 2)
+            chainLength++;
+        if (header.MipMapCount == 0 || header.MipMapCount > chainLength)
+            return false;
+
+        uint64_t bytes = 0;
+        int w = header.Width;
+        int h = header.Height;
+        for (uint32_t level = 0; level < header.MipMapCount; level++)
+        {
+            bytes += BlocksSize(w, h);
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        return bytes == levelsBytes;
+    }
+
+    //////////////////////////////////////////
+    void write(const CompressedTexture& texture)
+    {
+        ofstream file(this->cachePath, ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            cout << "WARNING::TEXTURE_CACHE:: unable to write " << this->cachePath << endl;
+            return;
+        }
+
+        DDSHeader header;
+        memset(&header, 0, sizeof(header));
+        header.Size = sizeof(DDSHeader);
+        // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+        header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+        header.Height = texture.Height;
+        header.Width = texture.Width;
+        header.PitchOrLinearSize = texture.Levels[0].size();
+        header.MipMapCount = texture.Levels.size();
+        header.Reserved1[0] = DDS_BAKER_TAG;
+        header.Reserved1[1] = TEXTURE_CACHE_VERSION;
+        header.Reserved1[2] = (uint32_t)this->key;
+        header.Reserved1[3] = (uint32_t)(this->key >> 32);
+        header.PixelFormat.Size = sizeof(DDSPixelFormat);
+        header.PixelFormat.Flags = 0x4; // FOURCC
+        header.PixelFormat.FourCC = DDS_FOURCC_DXT1;
+        // COMPLEX | TEXTURE | MIPMAP
+        header.Caps = 0x8 | 0x1000 | 0x400000;
+
+        uint32_t magic = DDS_MAGIC;
+        file.write((const char*)&magic, sizeof(magic));
+        file.write((const char*)&header, sizeof(header));
+        for (const vector<uint8_t>& level : texture.Levels)
+            file.write((const char*)level.data(), level.size());
+    }
+
+    //////////////////////////////////////////
+    // 2x2 box filter, the last row/column is repeated on odd sizes
+    static vector<uint8_t> downsample(const vector<uint8_t>& source, int width, int height)
+    {
+        int w = max(1, width / 2);
+        int h = max(1, height / 2);
+        vector<uint8_t> result(w * h * 3);
+        for (int y = 0; y < h; y++)
+        {
+            int y0 = min(y * 2, height - 1);
+            int y1 = min(y * 2 + 1, height - 1);
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = min(x * 2, width - 1);
+                int x1 = min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 3; c++)
+                {
+                    int sum = source[(y0 * width + x0) * 3 + c] + source[(y0 * width + x1) * 3 + c]
+                            + source[(y1 * width + x0) * 3 + c] + source[(y1 * width + x1) * 3 + c];
+                    result[(y * w + x) * 3 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+    //////////////////////////////////////////
+    static vector<uint8_t> compressLevel(const vector<uint8_t>& rgb, int width, int height)
+    {
+        vector<uint8_t> blocks(BlocksSize(width, height));
+        uint8_t* out = blocks.data();
+        uint8_t block[16 * 3];
+        for (int by = 0; by < height; by += 4)
+        {
+            for (int bx = 0; bx < width; bx += 4)
+            {
+                // blocks on the border of small levels repeat the last pixels
+                for (int y = 0; y < 4; y++)
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = min(bx + x, width - 1);
+                        int sy = min(by + y, height - 1);
+                        memcpy(&block[(y * 4 + x) * 3], &rgb[(sy * width + sx) * 3], 3);
+                    }
+                compressBlock(block, out);
+                out += 8;
+            }
+        }
+        return blocks;
+    }
+
+    static uint16_t to565(const float* color)
+    {
+        int r = (int)(min(255.0f, max(0.0f, color[0])) * 31.0f / 255.0f + 0.5f);
+        int g = (int)(min(255.0f, max(0.0f, color[1])) * 63.0f / 255.0f + 0.5f);
+        int b = (int)(min(255.0f, max(0.0f, color[2])) * 31.0f / 255.0f + 0.5f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(uint16_t color, int* rgb)
+    {
+        int r = (color >> 11) & 31;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    //////////////////////////////////////////
+    // BC1 block: the two endpoints are the extremes of the pixels along the principal axis of the colors
+    // (found with a few steps of power iteration), each pixel takes the closest of the 4 palette entries
+    static void compressBlock(const uint8_t* block, uint8_t* out)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i * 3 + c] / 16.0f;
+
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float r = block[i * 3] - mean[0];
+            float g = block[i * 3 + 1] - mean[1];
+            float b = block[i * 3 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; iteration++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = max(max(fabs(x), fabs(y)), fabs(z));
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        int minIndex = 0;
+        int maxIndex = 0;
+        float minProjection = 1e30f;
+        float maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float projection = block[i * 3] * axis[0] + block[i * 3 + 1] * axis[1] + block[i * 3 + 2] * axis[2];
+            if (projection < minProjection) { minProjection = projection; minIndex = i; }
+            if (projection > maxProjection) { maxProjection = projection; maxIndex = i; }
+        }
+
+        float maxColor[3] = { (float)block[maxIndex * 3], (float)block[maxIndex * 3 + 1], (float)block[maxIndex * 3 + 2] };
+        float minColor[3] = { (float)block[minIndex * 3], (float)block[minIndex * 3 + 1], (float)block[minIndex * 3 + 2] };
+        uint16_t color0 = to565(maxColor);
+        uint16_t color1 = to565(minColor);
+        // color0 > color1 selects the 4 colors mode (no transparency)
+        if (color0 < color1)
+            swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][3];
+            from565(color0, palette[0]);
+            from565(color1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0;
+                int bestDistance = 1 << 30;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = block[i * 3] - palette[p][0];
+                    int dg = block[i * 3 + 1] - palette[p][1];
+                    int db = block[i * 3 + 2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) { bestDistance = distance; best = p; }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+
+        out[0] = color0 & 0xFF;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xFF;
+        out[3] = color1 >> 8;
+        out[4] = indices & 0xFF;
+        out[5] = (indices >> 8) & 0xFF;
+        out[6] = (indices >> 16) & 0xFF;
+        out[7] = indices >> 24;
+    }
+};
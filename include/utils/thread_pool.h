@@ -0,0 +1,83 @@
+//--- FIXED POOL OF WORKER THREADS
+//--- JOBS ARE RUN IN FIFO ORDER, Enqueue RETURNS A FUTURE WITH THE RESULT OF THE JOB
+//--- NO OPENGL CALL CAN BE MADE BY A JOB: THE CONTEXT IS ONLY CURRENT ON THE MAIN THREAD
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    public:
+
+    ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {}
+
+    ThreadPool(unsigned int threads) {
+        if(threads == 0) {
+            threads = 2;
+        }
+        for(unsigned int i = 0; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool& copy) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for(std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    template<class F>
+    auto Enqueue(F job) -> std::future<decltype(job())> {
+        auto task = std::make_shared<std::packaged_task<decltype(job())()>>(job);
+        std::future<decltype(job())> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        available.notify_one();
+        return result;
+    }
+
+    unsigned int Size() {
+        return workers.size();
+    }
+
+    private:
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+    void work() {
+        while(true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if(stopping && jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
@@ -0,0 +1,98 @@
+//--- POOL OF PIXEL UNPACK BUFFERS FOR THE UPLOAD OF THE TEXTURES
+//--- A glTex(Sub)Image CALL READING FROM CLIENT MEMORY RETURNS ONLY WHEN THE DRIVER HAS COPIED THE PIXELS. WITH A PIXEL
+//--- UNPACK BUFFER BOUND, THE APP COPIES THE PIXELS IN THE (MAPPED) STAGING BUFFER AND THE CALL ONLY QUEUES THE TRANSFER
+//--- TO THE TEXTURE, THAT THE GPU DOES WHILE THE APP GOES ON (RENDERING, OR COPYING THE NEXT LEVEL IN THE NEXT BUFFER).
+//--- THE BUFFERS ARE USED IN TURN: A FENCE AFTER EACH TRANSFER TELLS WHEN ITS BUFFER CAN BE WRITTEN AGAIN.
+//--- THE BUFFERS ARE CREATED AT THE FIRST UPLOAD, SO THE POOL CAN BE A GLOBAL, AND THEY GROW WITH THE BIGGEST UPLOAD.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <utils/gl_state.h>
+
+//--- STAGING BUFFERS IN FLIGHT, AND THEIR STARTING SIZE
+#define UPLOAD_BUFFERS 4
+#define UPLOAD_BUFFER_SIZE (4 << 20)
+
+class UploadPool {
+    public:
+
+    UploadPool() = default;
+    UploadPool(const UploadPool& copy) = delete;
+    UploadPool& operator=(const UploadPool&) = delete;
+
+    //--- COPIES THE DATA IN THE NEXT FREE STAGING BUFFER AND CALLS transfer WITH THE BUFFER BOUND TO GL_PIXEL_UNPACK_BUFFER:
+    //--- transfer MUST PASS THE GIVEN POINTER (AN OFFSET IN THE BUFFER) AS THE PIXELS OF ITS glTex(Sub)Image CALL
+    template<typename Transfer>
+    void Upload(const void* data, GLsizeiptr bytes, Transfer transfer) {
+        if(stagings.empty()) {
+            stagings.resize(UPLOAD_BUFFERS);
+            for(Staging& staging : stagings) {
+                glGenBuffers(1, &staging.buffer);
+            }
+        }
+
+        Staging& staging = stagings[next];
+        next = (next + 1) % stagings.size();
+        wait(staging);
+
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+        if(bytes > staging.size) {
+            staging.size = std::max<GLsizeiptr>(bytes, UPLOAD_BUFFER_SIZE);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, staging.size, NULL, GL_STREAM_DRAW);
+        }
+
+        //--- THE FENCE HAS BEEN WAITED: NO NEED FOR THE DRIVER TO SYNCHRONIZE THE MAPPING
+        void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if(destination) {
+            memcpy(destination, data, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            transfer((const GLvoid*)0);
+            staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        } else {
+            //--- NO MAPPING: THE PIXELS ARE READ FROM CLIENT MEMORY, LIKE WITHOUT THE POOL
+            GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            transfer(data);
+        }
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    //--- LIKE Shader::Delete, TO BE CALLED WHILE THE CONTEXT IS STILL ALIVE
+    void Delete() {
+        for(Staging& staging : stagings) {
+            if(staging.fence) {
+                glDeleteSync(staging.fence);
+            }
+            GLState::Get().DeleteBuffers(1, &staging.buffer);
+        }
+        stagings.clear();
+        next = 0;
+    }
+
+    private:
+
+    struct Staging {
+        GLuint buffer = 0;
+        GLsizeiptr size = 0;
+        GLsync fence = 0;
+    };
+
+    std::vector<Staging> stagings;
+    size_t next = 0;
+
+    //--- WAITS FOR THE GPU TO FINISH THE PREVIOUS TRANSFER FROM THE BUFFER (NORMALLY ALREADY DONE, THE POOL IS A RING)
+    void wait(Staging& staging) {
+        if(!staging.fence) {
+            return;
+        }
+        GLenum result = glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while(result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(staging.fence);
+        staging.fence = 0;
+    }
+};
@@ -0,0 +1,167 @@
+/*
+VertexFormat - descriptor of the layout of the vertices in a VBO
+- each format lists its attributes (location, components, type, normalization, offset), and the VAO setup
+  is generated from the list, so a Mesh can be uploaded with a different layout without touching its code
+- two layouts are available:
+  Full    : the Vertex structure as it is (56 bytes): float positions, normals, UVs, tangents and bitangents
+  Compact : the CompactVertex structure (16 bytes):
+            positions quantized to 16 bit inside the bounding box of the mesh,
+            normals octahedral-encoded in two snorm16,
+            UVs stored as half floats,
+            no tangents and bitangents (they are not used by the shaders)
+
+Quantized positions are dequantized in the vertex shader with a per-mesh transform (offset + scale), that is passed
+as two constant vertex attributes (locations 5 and 6): they are not enabled as arrays in the VAO,
+so OpenGL uses their current value (set with glVertexAttrib3fv by Mesh before each draw) for every vertex.
+The Full layout uses an identity transform, so the positions and the UVs are read by the same shader with both layouts.
+The normals are not: the Full layout feeds location 1 with the raw xyz floats, while the shaders that read the normals
+(impostor_bake.vert) decode an octahedral vec2. A mesh drawn by those shaders must use the Compact layout.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// locations of the constant attributes with the dequantization transform of the positions
+#define POSITION_OFFSET_LOCATION 5
+#define POSITION_SCALE_LOCATION 6
+
+enum class VertexLayout { Full, Compact };
+
+struct VertexAttribute {
+    GLuint Location;
+    GLint Components;
+    GLenum Type;
+    GLboolean Normalized;
+    size_t Offset;
+};
+
+// 16 bytes vertex, see the description at the top of the file
+struct CompactVertex {
+    // xyz unorm16 inside the bounding box of the mesh, w is padding to keep the next attribute aligned
+    uint16_t Position[4];
+    // octahedral-encoded normal, snorm16
+    int16_t Normal[2];
+    // half floats
+    uint16_t TexCoords[2];
+};
+
+// per-mesh transform from the [0,1] quantized positions to the object space positions
+struct Dequantization {
+    glm::vec3 Offset = glm::vec3(0.0f);
+    glm::vec3 Scale = glm::vec3(1.0f);
+};
+
+struct VertexFormat {
+    GLsizei Stride;
+    vector<VertexAttribute> Attributes;
+
+    //////////////////////////////////////////
+    // it sets in the currently bound VAO the pointers to the attributes in the currently bound VBO
+    void Setup() const
+    {
+        for (const VertexAttribute& attribute : this->Attributes)
+        {
+            glEnableVertexAttribArray(attribute.Location);
+            glVertexAttribPointer(attribute.Location, attribute.Components, attribute.Type, attribute.Normalized, this->Stride, (GLvoid*)attribute.Offset);
+        }
+    }
+
+    //////////////////////////////////////////
+    static const VertexFormat& Get(VertexLayout layout)
+    {
+        static const VertexFormat full = {
+            sizeof(Vertex),
+            {
+                { 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position) },
+                { 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal) },
+                { 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords) },
+                { 3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent) },
+                { 4, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent) },
+            }
+        };
+        static const VertexFormat compact = {
+            sizeof(CompactVertex),
+            {
+                { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(CompactVertex, Position) },
+                { 1, 2, GL_SHORT, GL_TRUE, offsetof(CompactVertex, Normal) },
+                { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, TexCoords) },
+            }
+        };
+        return layout == VertexLayout::Compact ? compact : full;
+    }
+};
+
+//////////////////////////////////////////
+// octahedral encoding of a unit vector: the vector is projected on the octahedron |x|+|y|+|z| = 1,
+// and the lower half is folded on the upper one, so the result is a point in [-1,1]^2
+inline glm::vec2 octahedralEncode(glm::vec3 n)
+{
+    n /= (fabs(n.x) + fabs(n.y) + fabs(n.z));
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+inline int16_t packSnorm16(float v)
+{
+    return (int16_t)lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+//////////////////////////////////////////
+// conversion of the vertices of a mesh to the compact layout. It returns the transform to dequantize the positions
+inline Dequantization packCompactVertices(const vector<Vertex>& vertices, vector<CompactVertex>& packed)
+{
+    Dequantization transform;
+    packed.resize(vertices.size());
+    if (vertices.empty())
+        return transform;
+
+    // bounding box of the mesh
+    glm::vec3 minimum = vertices[0].Position;
+    glm::vec3 maximum = vertices[0].Position;
+    for (const Vertex& vertex : vertices)
+    {
+        minimum = glm::min(minimum, vertex.Position);
+        maximum = glm::max(maximum, vertex.Position);
+    }
+    transform.Offset = minimum;
+    transform.Scale = maximum - minimum;
+    // flat meshes (e.g. the plane) have a zero extent on one axis
+    for (int axis = 0; axis < 3; axis++)
+        if (transform.Scale[axis] <= 0.0f)
+            transform.Scale[axis] = 1.0f;
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& vertex = vertices[i];
+        CompactVertex& out = packed[i];
+
+        glm::vec3 quantized = glm::clamp((vertex.Position - transform.Offset) / transform.Scale, 0.0f, 1.0f);
+        for (int axis = 0; axis < 3; axis++)
+            out.Position[axis] = (uint16_t)lround(quantized[axis] * 65535.0f);
+        out.Position[3] = 0;
+
+        // degenerate normals are replaced by the up vector
+        glm::vec3 normal = glm::length(vertex.Normal) > 0.0f ? glm::normalize(vertex.Normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec2 encoded = octahedralEncode(normal);
+        out.Normal[0] = packSnorm16(encoded.x);
+        out.Normal[1] = packSnorm16(encoded.y);
+
+        out.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        out.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    }
+
+    return transform;
+}
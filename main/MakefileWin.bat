@@ -4,7 +4,24 @@ IF EXIST "C:\Program Files (x86)\Microsoft Visual Studio\2019\BuildTools\VC\Auxi
 ) ELSE (
     call "C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build\vcvarsall.bat" x64
 )
-set compilerflags=/Od /Zi /EHsc /MT
+set compilerflags=/Od /Zi /EHsc /MT /std:c++14
+rem the options can be combined, in any order: MakefileWin.bat hotreload embedded
+:options
+IF "%~1"=="" GOTO build
+rem map file watched and reloaded while the app runs: MakefileWin.bat hotreload
+IF "%~1"=="hotreload" set compilerflags=%compilerflags% /DMAP_HOT_RELOAD
+rem map baked at compile time: MakefileWin.bat embedded
+IF "%~1"=="embedded" GOTO embedded
+GOTO next
+:embedded
+> map_csv.inc echo R^"CSV^(
+type ..\data\map.csv >> map_csv.inc
+>> map_csv.inc echo ^)CSV^"
+set compilerflags=%compilerflags% /DEMBEDDED_MAP /constexpr:steps10000000
+:next
+shift
+GOTO options
+:build
 set includedirs=/I../include
 set linkerflags=/LIBPATH:../libs/win glfw3.lib assimp-vc142-mt.lib zlib.lib IrrXML.lib gdi32.lib user32.lib Shell32.lib
 cl.exe %compilerflags% %includedirs% ../include/glad/glad.c main.cpp /Fe:main.exe /link %linkerflags% 
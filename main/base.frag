@@ -5,18 +5,24 @@ layout(location = 0) out vec4 color;
 
 //--- INPUT FROM APP
 uniform sampler2D tex;
+//--- TEXTURE ARRAYS OF THE MATERIALS (SIZE = MAX_MATERIAL_ARRAYS), AND ARRAY/LAYER OF THE CURRENT ONE
+uniform sampler2DArray materials[8];
+uniform ivec2 material;
 uniform float repeat;
 uniform vec3 colorIn;
-uniform float distorsion;
-uniform float time;
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
 
 //--- INPUT FROM GEOMETRY SHADERS
 in vec2 interp_UV;
 
-//--- SUBROUTINES
-subroutine vec4 fragshader();
-subroutine uniform fragshader fragShaderImpl;
-
 //--- CONSTANTS
 const float PI = 3.1415926535;
 
@@ -97,17 +103,20 @@ float snoise(vec3 v) {
     return 42.0 * dot( m*m, vec4( dot(p0,x0), dot(p1,x1), dot(p2,x2), dot(p3,x3)));
 }
 
-//--- SUBROUTINE THAT APPLIES THE GIVEN TEXTURE
-subroutine(fragshader)
+//--- SAMPLES THE LAYER OF THE CURRENT MATERIAL
+vec4 materialTexture(vec2 uv) {
+    return texture(materials[material.x], vec3(uv, material.y));
+}
+
+//--- APPLIES THE GIVEN TEXTURE
 vec4 textured() {
     vec2 repeatedUV = mod(interp_UV * repeat, 1.0f);
-    return vec4(texture(tex, repeatedUV).xyz, 1.0f);
+    return vec4(materialTexture(repeatedUV).xyz, 1.0f);
 }
 
-//--- SUBROUTINE FOR THE FOOTPRINT
-subroutine(fragshader)
+//--- FOOTPRINT
 vec4 footprint() {
-    vec4 baseColor = texture(tex, interp_UV);
+    vec4 baseColor = materialTexture(interp_UV);
 
     if(baseColor.x < 0.1f && baseColor.y < 0.1f && baseColor.z < 0.1f) {
         discard;
@@ -116,28 +125,28 @@ vec4 footprint() {
     float texel = 1.0f / 512.0f * 2.0f;
 
     vec2 topTexel = interp_UV + vec2(0.0f, texel);
-    vec4 topColor = texture(tex, topTexel);
+    vec4 topColor = materialTexture(topTexel);
 
     vec2 bottomTexel = interp_UV + vec2(0.0f, -texel);
-    vec4 bottomColor = texture(tex, bottomTexel);
+    vec4 bottomColor = materialTexture(bottomTexel);
 
     vec2 leftTexel = interp_UV + vec2(-texel, 0.0f);
-    vec4 leftColor = texture(tex, leftTexel);
+    vec4 leftColor = materialTexture(leftTexel);
 
     vec2 rightTexel = interp_UV + vec2(-texel, 0.0f);
-    vec4 rightColor = texture(tex, rightTexel);
+    vec4 rightColor = materialTexture(rightTexel);
 
     vec2 topLeftTexel = interp_UV + vec2(-texel, texel);
-    vec4 topLeftColor = texture(tex, topLeftTexel);
+    vec4 topLeftColor = materialTexture(topLeftTexel);
 
     vec2 topRightTexel = interp_UV + vec2(texel, texel);
-    vec4 topRightColor = texture(tex, topRightTexel);
+    vec4 topRightColor = materialTexture(topRightTexel);
 
     vec2 bottomLeftTexel = interp_UV + vec2(-texel, -texel);
-    vec4 bottomLeftColor = texture(tex, bottomLeftTexel);
+    vec4 bottomLeftColor = materialTexture(bottomLeftTexel);
 
     vec2 bottomRightTexel = interp_UV + vec2(texel, -texel);
-    vec4 bottomRightColor = texture(tex, bottomRightTexel);
+    vec4 bottomRightColor = materialTexture(bottomRightTexel);
 
     bool variableAlpha = false;
 
@@ -161,8 +170,7 @@ vec4 footprint() {
 }
 
 
-//--- SUBROUTING THAT APPLIES A PINCUSHION DISTORSION
-subroutine(fragshader)
+//--- APPLIES A PINCUSHION DISTORSION
 vec4 pincushion() {
     vec2 repeatedUV = mod(interp_UV * repeat, 1.0f);
     float newX = interp_UV.x - 1.0f;
@@ -176,8 +184,7 @@ vec4 pincushion() {
     return vec4(col + vec3(distorsion/20.0f) + vec3(distorsion * y), 1.0f);
 }
 
-//--- SUBROUTINE THAT ALWAYS RETURNS THE GIVEN COLOR
-subroutine(fragshader)
+//--- ALWAYS RETURNS THE GIVEN COLOR
 vec4 fixedColor() {
     return vec4(colorIn, 1.0f);
 }
@@ -196,8 +203,7 @@ vec3 distortedColorByUv(vec2 interp_UV) {
     return col + vec3(distorsion/10.0f) + vec3(distorsion * y);
 }
 
-//--- SUBROUTINE THAT COLORS THE TRACE OF THE GREEN/RED TRACE TEXTURE
-subroutine(fragshader)
+//--- COLORS THE TRACE OF THE GREEN/RED TRACE TEXTURE
 vec4 tracePlane() {
 
     //--- IF I'M NOT IN WITCHER SENSES MODE, DISCARD ALL
@@ -333,6 +339,17 @@ vec4 tracePlane() {
     return vec4(colorIn, alpha * distorsion * -1);
 }
 
+//--- THE VARIANT OF THE PROGRAM (SEE ShaderPermutations) CHOOSES THE COLOR, TEXTURED BY DEFAULT
 void main() {
-    color = fragShaderImpl();
+#if defined(FOOTPRINT)
+    color = footprint();
+#elif defined(PINCUSHION)
+    color = pincushion();
+#elif defined(FIXED_COLOR)
+    color = fixedColor();
+#elif defined(TRACE_PLANE)
+    color = tracePlane();
+#else
+    color = textured();
+#endif
 }
\ No newline at end of file
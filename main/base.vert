@@ -1,45 +1,70 @@
 #version 410 core
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+layout (location = 0) in vec3 quantizedPosition;
+//--- THE NORMALS (LOCATION 1) ARE NOT USED BY THE BASE SHADERS
 layout (location = 2) in vec2 UV;
+//--- PER-MESH DEQUANTIZATION OF THE POSITIONS, CONSTANT FOR THE WHOLE DRAW CALL
+layout (location = 5) in vec3 positionOffset;
+layout (location = 6) in vec3 positionScale;
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
 
 //*** "BASIC" INPUT FROM APP ***//
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
 uniform mat4 modelMatrix;
-uniform mat4 modelMatrices[64];
 uniform mat3 normalMatrix;
 
-//--- UBO INPUT FROM APP
-layout (std140) uniform Matrices {
-    //--- HANDLING A MAXIMUM OF 1024 ELEMENTS
-    mat4 modelMatricesUbo[1024];
-};
+//--- INSTANCE DATA FROM APP, IN BUFFER TEXTURES WITHOUT A FIXED SIZE (SEE instance_buffer.h)
+//--- COMPACT INSTANCES, ONE RGBA32UI TEXEL EACH: POSITION, YAW AND SCALE (SEE Instance)
+uniform usamplerBuffer instances;
+//--- INDEXES OF THE TREES, GROUPED BY LOD
+uniform isamplerBuffer treeInstances;
+//--- FIRST INDEX OF THE LOD DRAWN BY THE CURRENT CALL
+uniform int instanceOffset;
 
 //--- OUTPUT TO FRAGMENT SHADER
 out vec2 interp_UV;
 
-//--- SUBROUTINES
-subroutine vec4 vertshader();
-subroutine uniform vertshader vertshaderImpl;
-
-subroutine(vertshader)
-vec4 standard() {
-    return projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0);
+vec3 position() {
+    return quantizedPosition * positionScale + positionOffset;
 }
 
-subroutine(vertshader)
-vec4 instancedUbo() {
-    return projectionMatrix * viewMatrix * modelMatricesUbo[gl_InstanceID] * vec4(position, 1.0);
+const float PI = 3.1415926535;
+
+mat4 instanceMatrix(int instance) {
+    uvec4 texel = texelFetch(instances, instance);
+    float yaw = float(texel.w & 0xFFFFu) / 65536.0 * 2.0 * PI;
+    float scale = float(texel.w >> 16) / 4096.0;
+    float c = cos(yaw) * scale;
+    float s = sin(yaw) * scale;
+    //--- TRANSLATE * ROTATE AROUND Y * SCALE, LIKE Instance::Matrix
+    return mat4(vec4(c, 0.0, -s, 0.0), vec4(0.0, scale, 0.0, 0.0), vec4(s, 0.0, c, 0.0), vec4(uintBitsToFloat(texel.xyz), 1.0));
 }
 
-subroutine(vertshader)
-vec4 instancedBase() {
-    return projectionMatrix * viewMatrix * modelMatrices[gl_InstanceID] * vec4(position, 1.0);
+//--- VARIANTS OF THE TRANSFORM, CHOSEN BY THE DEFINES OF THE PROGRAM (SEE ShaderPermutations)
+#if defined(INSTANCED_LOD)
+vec4 transform() {
+    int tree = texelFetch(treeInstances, gl_InstanceID + instanceOffset).r;
+    return projectionMatrix * viewMatrix * instanceMatrix(tree) * vec4(position(), 1.0);
+}
+#elif defined(INSTANCED_BASE)
+vec4 transform() {
+    return projectionMatrix * viewMatrix * instanceMatrix(gl_InstanceID) * vec4(position(), 1.0);
+}
+#else
+//--- STANDARD
+vec4 transform() {
+    return projectionMatrix * viewMatrix * modelMatrix * vec4(position(), 1.0);
 }
+#endif
 
 void main() {
     interp_UV = UV;
-    gl_Position = vertshaderImpl();
+    gl_Position = transform();
 }
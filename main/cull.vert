@@ -0,0 +1,63 @@
+#version 410 core
+
+//--- CULLING OF THE TREES ON THE GPU: ONE VERTEX FOR EACH TREE (NO VERTEX ATTRIBUTES, THE TREE IS gl_VertexID).
+//--- IT TESTS THE BOUNDING SPHERE OF THE TREE AGAINST THE FRUSTUM AND SELECTS ITS LOD LIKE drawTrees IN main.cpp,
+//--- cull.geom KEEPS ONLY THE TREES OF THE LOD OF THE PASS
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
+
+//--- INPUT FROM APP
+//--- PLANES OF THE FRUSTUM OF THE GAME CAMERA, NORMALIZED AND POINTING INSIDE (SEE frustum.h)
+uniform vec4 frustumPlanes[6];
+//--- BOUNDING SPHERE OF THE TREE, IN OBJECT SPACE
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+//--- SAME VALUES USED BY THE LODS ON THE CPU
+uniform float lodPixelsPerUnit;
+uniform float lodPixelError;
+uniform float impostorPixelRadius;
+uniform float lodErrors[MAX_LODS];
+uniform int lodCount;
+
+//--- SAME BUFFER TEXTURE OF base.vert
+uniform usamplerBuffer instances;
+
+//--- OUTPUT TO GEOMETRY SHADER: THE TREE AND ITS LOD, -1 FOR THE CULLED TREES, lodCount FOR THE IMPOSTORS
+flat out int vIndex;
+flat out int vLod;
+
+void main() {
+    uvec4 texel = texelFetch(instances, gl_VertexID);
+    float scale = float(texel.w >> 16) / 4096.0;
+    //--- THE TREES ARE NOT ROTATED (SEE buildTreesSpheres)
+    vec3 position = uintBitsToFloat(texel.xyz);
+    vec3 center = position + impostorCenter * scale;
+    float radius = impostorRadius * scale;
+
+    vIndex = gl_VertexID;
+    vLod = -1;
+    for (int i = 0; i < 6; i++) {
+        if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w <= -radius) {
+            return;
+        }
+    }
+
+    //--- LIKE pixelsPerUnit AND Model::SelectLod
+    float pixels = lodPixelsPerUnit * scale / max(length(position - cameraPosition.xyz), 0.1);
+    if (pixels * impostorRadius < impostorPixelRadius) {
+        vLod = lodCount;
+        return;
+    }
+    int lod = 0;
+    while (lod + 1 < lodCount && lodErrors[lod + 1] * pixels < lodPixelError) {
+        lod++;
+    }
+    vLod = lod;
+}
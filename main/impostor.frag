@@ -0,0 +1,38 @@
+#version 410 core
+
+//--- OUTPUT TO FRAME BUFFER
+layout(location = 0) out vec4 color;
+
+//--- INPUT FROM APP
+uniform sampler2D impostorColor;
+uniform sampler2D impostorNormalDepth;
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
+
+//--- INPUT FROM VERTEX SHADER
+in vec2 interp_UV;
+in vec3 interp_viewPosition;
+flat in float interp_radius;
+
+void main() {
+    vec4 baseColor = texture(impostorColor, interp_UV);
+    if(baseColor.a < 0.5f) {
+        discard;
+    }
+    color = vec4(baseColor.xyz / baseColor.a, 1.0f);
+
+    //--- THE BAKED DEPTH MOVES THE FRAGMENT FROM THE PLANE OF THE QUAD TO THE SURFACE OF THE TREE,
+    //--- SO IMPOSTORS INTERSECT THE GROUND AND EACH OTHER LIKE THE REAL GEOMETRY
+    //--- (DEPTH 0.5 IS THE CENTER OF THE BOUNDING SPHERE, 0 AND 1 ARE ITS FRONT AND BACK)
+    float depth = texture(impostorNormalDepth, interp_UV).a;
+    vec3 surface = interp_viewPosition + vec3(0.0, 0.0, interp_radius * (1.0 - 2.0 * depth));
+    vec4 clip = projectionMatrix * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+}
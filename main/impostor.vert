@@ -0,0 +1,65 @@
+#version 410 core
+
+//--- NO VERTEX ATTRIBUTES: THE CORNERS OF THE QUAD ARE BUILT FROM gl_VertexID (TRIANGLE STRIP OF 4 VERTICES)
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
+
+//--- INPUT FROM APP
+//--- BOUNDING SPHERE OF THE MODEL, IN OBJECT SPACE
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+//--- NUMBER OF VIEWS IN THE ATLAS, AROUND THE Y AXIS
+uniform int impostorViews;
+
+//--- SAME BUFFER TEXTURES OF base.vert
+uniform usamplerBuffer instances;
+uniform isamplerBuffer treeInstances;
+uniform int instanceOffset;
+
+//--- OUTPUT TO FRAGMENT SHADER
+out vec2 interp_UV;
+out vec3 interp_viewPosition;
+flat out float interp_radius;
+
+const float PI = 3.1415926535;
+
+mat4 instanceMatrix(int instance) {
+    uvec4 texel = texelFetch(instances, instance);
+    float yaw = float(texel.w & 0xFFFFu) / 65536.0 * 2.0 * PI;
+    float scale = float(texel.w >> 16) / 4096.0;
+    float c = cos(yaw) * scale;
+    float s = sin(yaw) * scale;
+    //--- TRANSLATE * ROTATE AROUND Y * SCALE, LIKE Instance::Matrix
+    return mat4(vec4(c, 0.0, -s, 0.0), vec4(0.0, scale, 0.0, 0.0), vec4(s, 0.0, c, 0.0), vec4(uintBitsToFloat(texel.xyz), 1.0));
+}
+
+void main() {
+    mat4 model = instanceMatrix(texelFetch(treeInstances, gl_InstanceID + instanceOffset).r);
+    float scale = length(model[0].xyz);
+    vec3 center = (model * vec4(impostorCenter, 1.0)).xyz;
+
+    //--- THE QUAD ONLY ROTATES AROUND THE Y AXIS, LIKE THE VIEWS OF THE ATLAS
+    vec3 toCamera = cameraPosition.xyz - center;
+    vec3 forward = normalize(vec3(toCamera.x, 0.0, toCamera.z) + vec3(0.0, 0.0, 1e-5));
+    vec3 right = vec3(forward.z, 0.0, -forward.x);
+
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 world = center + (right * corner.x + vec3(0.0, corner.y, 0.0)) * impostorRadius * scale;
+
+    //--- NEAREST BAKED VIEW
+    float azimuth = atan(forward.x, forward.z);
+    int view = int(round(azimuth / (2.0 * PI) * float(impostorViews)));
+    view = (view % impostorViews + impostorViews) % impostorViews;
+    interp_UV = vec2((float(view) + corner.x * 0.5 + 0.5) / float(impostorViews), corner.y * 0.5 + 0.5);
+
+    interp_radius = impostorRadius * scale;
+    interp_viewPosition = (viewMatrix * vec4(world, 1.0)).xyz;
+    gl_Position = projectionMatrix * vec4(interp_viewPosition, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+//--- OUTPUT TO THE TWO TEXTURES OF THE ATLAS
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 normalDepth;
+
+//--- INPUT FROM APP
+uniform sampler2DArray materials[8];
+uniform ivec2 material;
+
+//--- INPUT FROM VERTEX SHADER
+in vec2 interp_UV;
+in vec3 interp_normal;
+
+void main() {
+    //--- SAME SAMPLING OF THE TEXTURED VARIANT OF base.frag, ALPHA MARKS THE COVERED TEXELS
+    color = vec4(texture(materials[material.x], vec3(mod(interp_UV, 1.0f), material.y)).xyz, 1.0f);
+    //--- THE ORTHOGRAPHIC DEPTH IS LINEAR
+    normalDepth = vec4(normalize(interp_normal) * 0.5f + 0.5f, gl_FragCoord.z);
+}
@@ -0,0 +1,32 @@
+#version 410 core
+
+layout (location = 0) in vec3 quantizedPosition;
+//--- OCTAHEDRAL-ENCODED NORMAL: ONLY THE COMPACT LAYOUT (SEE vertex_format.h)
+layout (location = 1) in vec2 normal;
+layout (location = 2) in vec2 UV;
+//--- PER-MESH DEQUANTIZATION OF THE POSITIONS
+layout (location = 5) in vec3 positionOffset;
+layout (location = 6) in vec3 positionScale;
+
+//--- ORTHOGRAPHIC CAMERA OF THE CURRENT VIEW OF THE ATLAS
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+//--- OUTPUT TO FRAGMENT SHADER
+out vec2 interp_UV;
+out vec3 interp_normal;
+
+vec3 decodeNormal() {
+    vec3 n = vec3(normal, 1.0 - abs(normal.x) - abs(normal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    interp_UV = UV;
+    //--- NORMALS ARE STORED IN THE SPACE OF THE VIEW, THE SAME SPACE OF THE CAMERA-FACING QUAD AT RUNTIME
+    interp_normal = mat3(viewMatrix) * decodeNormal();
+    gl_Position = projectionMatrix * viewMatrix * vec4(quantizedPosition * positionScale + positionOffset, 1.0);
+}
@@ -6,8 +6,11 @@
     #define APIENTRY __stdcall
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <set>
+#include <unordered_map>
 
 #include <glad/glad.h>
 
@@ -20,10 +23,23 @@
 #endif
 
 //---  classes developed during lab lectures to manage shaders and to load models
+#include <utils/gl_state.h>
 #include <utils/shader_v1.h>
 #include <utils/model_v1.h>
 #include <utils/aabb.h>
 #include <utils/csv_loader.h>
+#include <utils/embedded_map.h>
+#include <utils/file_watcher.h>
+#include <utils/thread_pool.h>
+#include <utils/texture_cache.h>
+#include <utils/material_arrays.h>
+#include <utils/impostor.h>
+#include <utils/stream_buffer.h>
+#include <utils/draw_list.h>
+#include <utils/render_queue.h>
+#include <utils/instance_buffer.h>
+#include <utils/frame_uniforms.h>
+#include <utils/frustum.h>
 #include <utils/vertices.h>
 
 //---  we load the GLM classes used in the application
@@ -65,11 +81,33 @@ vector<std::string> shaders;
 GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 
+//--- CALLS TO THE DRIVER ISSUED AND SKIPPED BY THE STATE CACHE (SEE gl_state.h), SWITCHED WITH I
+bool showGLCalls = false;
+GLfloat lastGLCallsPrint = 0.0f;
+
+//--- WORKER THREADS FOR THE CPU SIDE OF THE LOADING
+ThreadPool workers;
+
 //---  TEXTURES AND MODELS
-vector<GLint> textures;
+//--- THE TEXTURES ARE LAYERS OF A FEW ARRAYS, BOUND ONCE: A MATERIAL SELECTS ITS ARRAY AND LAYER WITH A UNIFORM
+MaterialArrays materialArrays;
+vector<Material> materials;
+//--- STAGING BUFFERS OF THE TEXTURE UPLOADS, THE GPU COPIES THE PIXELS WHILE THE APP GOES ON
+UploadPool uploadPool;
 vector<Model> models;
 vector<glm::mat4> matrices;
-GLint LoadTexture(const char* path);
+//--- DECODED (OR BAKED) TEXTURE, WAITING TO BE UPLOADED
+struct TextureData {
+    CompressedTexture Compressed;
+    unsigned char* Pixels = nullptr;
+    int Width = 0;
+    int Height = 0;
+    int Channels = 0;
+};
+TextureData decodeTexture(string path);
+void uploadMaterials(vector<TextureData>& decoded);
+//--- TRUE IF THE DRIVER SUPPORTS THE BAKED BC1 TEXTURES
+bool compressedTextures = false;
 
 //---  MOVEMENT 
 GLfloat oldDeltaZ = 0.0f;
@@ -111,11 +149,71 @@ struct Footprint {
 };
 
 
-//--- MATRIXES FOR INSTANCED DRAWING 
-vector<glm::mat4> treesMatrixes;
+//--- INSTANCES FOR INSTANCED DRAWING (COMPACT, 16 BYTES EACH, SEE instance_buffer.h)
+vector<Instance> treesInstances;
+//--- MAP CELL (ROW, COLUMN) OF EACH TREE, SAME ORDER OF treesInstances
+vector<glm::ivec2> treesCells;
+//--- INDEXES OF THE TREES GROUPED BY LOD, REBUILT EVERY FRAME
+vector<GLint> treesLodInstances;
+//--- THE INSTANCES ARE READ FROM BUFFER TEXTURES, WITHOUT A MAXIMUM NUMBER, BOUND ONCE TO THEIR UNITS
+//--- (AFTER THE IMPOSTOR ATLAS AND THE MATERIAL ARRAYS)
+#define TREES_UNIT 12
+#define TREES_LOD_UNIT 13
+#define FOOTPRINTS_UNIT 14
+InstanceBuffer treesBuffer(GL_RGBA32UI, sizeof(Instance));
+InstanceBuffer footprintsBuffer(GL_RGBA32UI, sizeof(Instance));
+//--- BUFFER TEXTURE OF THE INDEXES BY LOD, IT READS THE STREAM BUFFER WHERE THEY ARE WRITTEN
+GLuint treesLodTexture = 0;
+//--- INDIRECT DRAWS OF THE INSTANCED BATCHES: ONE BATCH FOR EACH LOD OF THE TREES (THE INDEX OF THE BATCH IS THE LOD),
+//--- ONE FOR THE FOOTPRINTS
+DrawList treesDraws;
+DrawList footprintsDraws;
+//--- FRAMES OF PER-FRAME DATA THAT FIT IN A STREAM BUFFER BEFORE IT WRAPS
+#define STREAM_FRAMES 4
+
+//--- LEVELS OF DETAIL
+//--- MAXIMUM ERROR ON THE SCREEN, IN PIXELS, OF THE SIMPLIFIED MODELS
+#define LOD_PIXEL_ERROR 1.0f
+glm::vec3 lodCameraPosition = glm::vec3(0.0f);
+
+//--- FAR TREES ARE DRAWN AS BILLBOARDS, BAKED FROM IMPOSTOR_VIEWS DIRECTIONS AROUND THE TREE
+#define IMPOSTOR_VIEWS 16
+#define IMPOSTOR_RESOLUTION 128
+//--- A TREE SMALLER THAN THIS ON THE SCREEN (RADIUS IN PIXELS) BECOMES AN IMPOSTOR
+#define IMPOSTOR_PIXEL_RADIUS 24.0f
+Impostor treeImpostor;
+
+//--- FRUSTUM CULLING OF THE TREES
+//--- BOUNDING SPHERES OF THE TREES, SAME ORDER OF treesInstances (SORTED BY MORTON CODE OF THEIR CELL AFTER LOADING,
+//--- SO THE TREES OF A CHUNK ARE CLOSE ON THE MAP, AND THE VISIBLE ONES ARE MOSTLY CONTIGUOUS)
+SphereSet treesSpheres;
+Frustum lodFrustum;
+//--- TREES CULLED BY EACH JOB OF THE WORKERS
+#define CULL_CHUNK 4096
+//--- CULLING ON THE GPU (SWITCHED WITH G): cull.vert/cull.geom WRITE THE INDEXES OF THE VISIBLE TREES WITH TRANSFORM
+//--- FEEDBACK, ONE PASS FOR EACH LOD IN ITS OWN RANGE OF treesCullBuffer, AND A QUERY COUNTS THE TREES OF EACH PASS.
+//--- THE COUNTS ARE READ ONE FRAME LATE, SO THE CPU NEVER WAITS FOR THE PASSES: EACH OF THE CULL_FRAMES SETS HAS ITS
+//--- QUERIES AND ITS PART OF treesCullBuffer, THE CULLING OF A FRAME WRITES ONE SET AND THE TREES ARE DRAWN WITH THE
+//--- SET OF THE PREVIOUS FRAME (GL 4.1 HAS NO WAY TO TAKE THE INSTANCES OF A DRAW FROM THE GPU)
+#define CULL_FRAMES 2
+struct CullFrame {
+    GLuint Queries[MAX_LODS + 1];
+    //--- FIRST INDEX OF THE SET IN treesCullBuffer AND TREES CULLED BY ITS PASSES, 0 IF THE SET HAS NO RESULTS
+    GLint First;
+    GLsizei Count;
+};
+bool gpuCulling = false;
+InstanceBuffer treesCullBuffer(GL_R32I, sizeof(GLint));
+CullFrame cullFrames[CULL_FRAMES];
+int cullFrame = 0;
+GLuint cullVAO = 0;
+//--- PIXELS COVERED BY ONE UNIT AT DISTANCE 1 FROM THE CAMERA
+float lodPixelsPerUnit = 0.0f;
 vector<Footprint> footprints;
 vector<Point> footprintsPoints;
-vector<glm::mat4> footprintsMatrixes;
+vector<Instance> footprintsInstances;
+//--- TRUE WHEN THE FOOTPRINTS MUST BE UPLOADED AGAIN
+bool footprintsChanged = false;
 
 //--- AABBs list
 vector<AABB> AABBs;
@@ -142,23 +240,96 @@ vector<glm::vec2> paths;
 //--- ODOR PATH DATA
 vector<glm::vec2> odor;
 vector<Point> points;
-
+//--- THE POINTS ARE UPLOADED ONLY WHEN THE PATH CHANGES
+GLuint pointsVAO = 0;
+GLuint pointsVBO = 0;
+bool pointsChanged = true;
+
+#ifdef EMBEDDED_MAP
+//--- MAP BAKED AT COMPILE TIME FROM ../data/map.csv (SEE THE Makefile)
+constexpr EmbeddedMap content = parseEmbeddedMap(
+#include "map_csv.inc"
+);
+static_assert(content.isValid(), "data/map.csv is malformed: check content.Error, ErrorRow and ErrorColumn");
+#else
 //--- LOAD CSV DATA FILE
 //--- I EXPECT A 32x32 CSV LIKE THE PLANE OF THE SIZE
-vector<vector<string>> content = CsvLoader().read("../data/map.csv");
+#define MAP_PATH "../data/map.csv"
+vector<vector<string>> content = CsvLoader().read(MAP_PATH);
+#endif
+
+#if defined(MAP_HOT_RELOAD) && !defined(EMBEDDED_MAP)
+//--- WATCH THE MAP FILE AND APPLY ITS CHANGES WHILE THE APP IS RUNNING
+FileWatcher mapWatcher = FileWatcher(MAP_PATH, 0.5);
+void reloadMap();
+#endif
 
 //--- SHADER LOCATIONS
-string locationNames[] { "projectionMatrix", "viewMatrix", "tex", "repeat", "modelMatrix", "modelMatrixes", "colorIn", "distorsion", "time" }; 
-
-#define LOCATION_PROJECTION_MATRIX 0
-#define LOCATION_VIEW_MATRIX 1
-#define LOCATION_TEXTURE 2
-#define LOCATION_REPEAT 3
-#define LOCATION_MODEL_MATRIX 4
-#define LOCATION_MODEL_MATRIXES 5
-#define LOCATION_COLOR 6
-#define LOCATION_DISTORSION 7
-#define LOCATION_TIME 8
+//--- (CAMERA, TIME AND DISTORSION ARE IN THE FRAME BLOCK, SEE frame_uniforms.h)
+string locationNames[] { "tex", "repeat", "modelMatrix", "instances", "colorIn", "instanceOffset", "material", "treeInstances" }; 
+
+#define LOCATION_TEXTURE 0
+#define LOCATION_REPEAT 1
+#define LOCATION_MODEL_MATRIX 2
+#define LOCATION_INSTANCES 3
+#define LOCATION_COLOR 4
+#define LOCATION_INSTANCE_OFFSET 5
+#define LOCATION_MATERIAL 6
+#define LOCATION_TREE_INSTANCES 7
+
+//--- VARIANTS OF THE BASE SHADER: ONE PROGRAM FOR EACH COMBINATION OF TRANSFORM (base.vert) AND COLOR (base.frag) IN USE
+enum BaseVariant { BASE_TEXTURED, BASE_TREES, BASE_FOOTPRINT, BASE_FIXED_COLOR, BASE_PINCUSHION, BASE_TRACE_PLANE, BASE_VARIANTS };
+vector<string> baseVariantDefines[BASE_VARIANTS] {
+    { "STANDARD", "TEXTURED" },
+    { "INSTANCED_LOD", "TEXTURED" },
+    { "INSTANCED_BASE", "FOOTPRINT" },
+    { "STANDARD", "FIXED_COLOR" },
+    { "STANDARD", "PINCUSHION" },
+    { "STANDARD", "TRACE_PLANE" }
+};
+
+struct BaseProgram {
+    Shader* Program;
+    vector<GLint> Locations;
+};
+BaseProgram basePrograms[BASE_VARIANTS];
+BaseVariant currentBase = BASE_TEXTURED;
+
+//--- UNIFORMS OF THE POINTS AND OF THE IMPOSTOR SHADERS
+struct PointsUniforms {
+    GLint Material;
+} pointsUniforms;
+
+struct ImpostorUniforms {
+    GLint InstanceOffset;
+} impostorUniforms;
+
+struct CullUniforms {
+    GLint FrustumPlanes;
+    GLint LodPixelsPerUnit;
+    GLint CullLod;
+} cullUniforms;
+
+//--- VIEWS OF THE FRAME: THE GAME CAMERA, AND THE FIXED CAMERA OF THE QUADS OF THE HIGHLIGHTS AND OF THE POST PROCESSING
+enum FrameView { VIEW_GAME, VIEW_SCREEN, FRAME_VIEWS };
+//--- EVERY VIEW IS WRITTEN ONCE PER FRAME IN THE RING BUFFER, HERE ARE THE OFFSETS OF THE CURRENT FRAME
+GLintptr frameViewOffsets[FRAME_VIEWS];
+
+//--- OPAQUE DRAWS OF THE GAME VIEW, EXECUTED IN THE ORDER OF THE RENDER QUEUE (SEE render_queue.h)
+enum RenderPass { PASS_OPAQUE };
+struct SceneDraw {
+    BaseVariant Variant;
+    int Model;
+    int Lod;
+    glm::mat4 Matrix;
+    float Repeat;
+    //--- THE TREES ARE DRAWN BY drawTrees (INSTANCED BATCHES OF EACH LOD AND IMPOSTORS)
+    bool Trees;
+};
+vector<SceneDraw> sceneDraws;
+RenderQueue renderQueue;
+//--- THE DEPTH OF THE KEYS COVERS THE WHOLE FRUSTUM (FAR PLANE OF THE PROJECTION)
+#define RENDER_QUEUE_MAX_DEPTH 10000.0f
 
 //--- OUTLINE COLORS
 GLfloat redColor[] = { 1.0f, 0.0f, 0.0f };
@@ -166,17 +337,47 @@ GLfloat yellowColor[] = { 1.0f, 1.0f, 0.0f };
 
 //--- UTILS METHODS
 void clear();
-void setTexture(int index, GLint repeatLocation, float repeatValue);
+void setMaterial(int index, float repeatValue);
+void initBasePrograms(ShaderPermutations& baseShaders);
+void enableParallelShaderCompile();
+void resolveShaderHandles(Shader& pointsShader, Shader& impostorShader, Shader& cullShader);
+void useBase(BaseVariant variant);
+GLint baseLocation(int location);
+glm::mat4 screenView();
+void writeFrameViews(StreamBuffer& frameStream, glm::mat4 projection, glm::mat4 gameView);
+void bindFrameView(StreamBuffer& frameStream, FrameView frameView);
 void loadAABBs();
+AABB buildTreeAABB(const Instance& tree);
+AABB buildCartAABB();
+AABB buildHouseAABB();
 void addToAABBsHierarchy(vector<AABB> aabb);
 void loadNextRow();
+void loadCell(char type, int order, int row, int column);
+int mapRows();
 void interpolateOdorPath();
 void createFootprintsPath();
-void drawPlayer(Shader shader, vector<GLint> locations, float scaleModifier);
-void drawBody(Shader shader, vector<GLint> locations, float scaleModifier, string subroutine);
-void drawCart(Shader shader, vector<GLint> locations, float scaleModifier, string subroutine);
-void drawPlane(Shader shader, glm::mat4 projection, glm::mat4 view, vector<GLint> locations);
+glm::mat4 playerMatrix(float scaleModifier);
+glm::mat4 bodyMatrix(float scaleModifier);
+glm::mat4 cartMatrix(float scaleModifier);
+glm::mat4 houseMatrix();
+void drawPlayer(float scaleModifier);
+void drawBody(float scaleModifier, BaseVariant variant);
+void drawCart(float scaleModifier, BaseVariant variant);
+void submitDraw(BaseVariant variant, int model, glm::mat4 matrix, float repeat, int lod);
+void submitTrees();
+void executeRenderQueue(Shader& impostorShader, StreamBuffer& lodStream, StreamBuffer& drawStream, bool treesCulledOnGpu);
 glm::vec2 buildCameraPosition(GLfloat distance);
+void updateLodCamera(glm::mat4 projection, glm::mat4 view);
+float pixelsPerUnit(glm::mat4 model);
+float pixelsPerUnit(glm::vec3 position, float scale);
+int selectLod(int index, glm::mat4 model);
+void buildTreesSpheres();
+void mortonOrderTrees();
+void setupTreesCulling(Shader& cullShader);
+void cullTreesOnGpu(Shader& cullShader);
+void cullTreesOnCpu(StreamBuffer& lodStream, vector<GLint>& lodFirst, vector<GLint>& lodInstances);
+bool readTreesCulledOnGpu(vector<GLint>& lodFirst, vector<GLint>& lodInstances);
+void drawTrees(Shader& impostorShader, StreamBuffer& lodStream, StreamBuffer& drawStream, bool culledOnGpu);
 string vecToString(glm::vec2 vector);
 string vecToString(glm::vec3 vector);
 
@@ -216,35 +417,90 @@ int main()
         return -1;
     }
 
+    compressedTextures = TextureCache::IsSupported();
+    if(!compressedTextures) {
+        cout << "BC1 textures not supported, textures will be decoded at every launch" << endl;
+    }
+
     //---  INIT VIEWPORT 
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
     glViewport(0, 0, width, height);
 
     //--- ENABLE DEPTH TEST, STENCIL TEST AND ALPHA BLENDING
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_STENCIL_TEST);
+    GLState::Get().Enable(GL_DEPTH_TEST);
+    GLState::Get().Enable(GL_STENCIL_TEST);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
-    glEnable(GL_PROGRAM_POINT_SIZE);
+    GLState::Get().Enable(GL_BLEND);
+    GLState::Get().Enable(GL_PROGRAM_POINT_SIZE);
 
     //--- SET CLEAR COLOR
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     //---  INIT SHADERS 
-    Shader baseShader = Shader("base.vert", "base.frag");
+    //--- THE PROGRAMS ARE LOADED FROM THEIR BINARY CACHE, OR SUBMITTED FOR COMPILATION: THEIR STATUS IS READ ONLY
+    //--- AT THEIR FIRST USE, AFTER ALL OF THEM HAVE BEEN CREATED
+    enableParallelShaderCompile();
+    ShaderPermutations baseShaders("base.vert", "base.frag");
     Shader pointsShader = Shader("points.vert", "points.frag", "points.geom");
+    Shader impostorBakeShader = Shader("impostor_bake.vert", "impostor_bake.frag");
+    Shader impostorShader = Shader("impostor.vert", "impostor.frag");
+    Shader cullShader = Shader("cull.vert", "cull.geom", { "cullIndex" }, { "MAX_LODS " + to_string(MAX_LODS) });
+
+    //--- VARIANTS OF THE BASE SHADER AND SHADER LOCATIONS, RESOLVED ONCE FROM THE REFLECTION OF THE PROGRAMS
+    initBasePrograms(baseShaders);
+    resolveShaderHandles(pointsShader, impostorShader, cullShader);
 
     //--- LOAD TEXTURES MODELS, MATRICES
     string names[] { "coin", "plane", "dog", "cart", "tree", "house", "odor", "footprints" }; 
+
+    //--- TEXTURES ARE DECODED AND MODELS ARE IMPORTED IN PARALLEL ON THE WORKERS
+    vector<future<TextureData>> decodes;
+    vector<future<vector<MeshData>>> imports;
     for (string name : names) {
-        textures.push_back(LoadTexture(("../textures/" + name + ".jpg").c_str()));
-        models.push_back(Model("../models/" + name + ".obj"));
-        matrices.push_back(glm::mat4(1.0f));
+        decodes.push_back(workers.Enqueue([name] { return decodeTexture("../textures/" + name + ".jpg"); }));
+        imports.push_back(workers.Enqueue([name] { return Model::Import("../models/" + name + ".obj"); }));
+    }
+
+    //--- THE CONTEXT THREAD COLLECTS EACH TEXTURE AS SOON AS IT'S READY (THE ARRAYS ARE CREATED
+    //--- WHEN THE SIZES OF ALL THE TEXTURES ARE KNOWN), WHILE MODELS ARE CREATED IN THE ORDER OF THE INDEXES
+    vector<TextureData> decoded(decodes.size());
+    size_t pendingTextures = decodes.size();
+    while (pendingTextures > 0 || models.size() < imports.size()) {
+        bool uploaded = false;
+        for (size_t i = 0; i < decodes.size(); i++) {
+            if (decodes[i].valid() && decodes[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                decoded[i] = decodes[i].get();
+                pendingTextures--;
+                uploaded = true;
+            }
+        }
+        size_t next = models.size();
+        if (next < imports.size() && imports[next].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            vector<MeshData> data = imports[next].get();
+            models.push_back(Model(data));
+            matrices.push_back(glm::mat4(1.0f));
+            uploaded = true;
+        }
+        if (!uploaded) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
 
+    uploadMaterials(decoded);
+
+    //--- THE SAMPLERS OF THE MATERIALS NEVER CHANGE UNIT, THEY ARE SET ONCE (FOR THE BASE VARIANTS IN initBasePrograms)
+    pointsShader.Use();
+    MaterialArrays::SetSamplers(pointsShader);
+
     cout << "Loaded textures and models" << endl;
 
+    //--- BAKE THE ATLAS OF THE TREE IMPOSTORS
+    treeImpostor.Bake(models[TREE_INDEX], materials[TREE_INDEX], impostorBakeShader, IMPOSTOR_VIEWS, IMPOSTOR_RESOLUTION);
+    impostorShader.Use();
+    treeImpostor.SetUniforms(impostorShader);
+    setupTreesCulling(cullShader);
+
     //--- INIT FIXED PLANE MATRIX
     matrices[PLANE_INDEX] = glm::translate(matrices[PLANE_INDEX], glm::vec3(32.0f, 0.0f, 32.0f));
     matrices[PLANE_INDEX] = glm::rotate(matrices[PLANE_INDEX], glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
@@ -258,6 +514,9 @@ int main()
     glm::mat4 projection = glm::perspective(45.0f, (float)screenWidth/(float)screenHeight, 0.1f, 10000.0f);
     glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
+    //--- CONSTANTS OF THE VIEWS, WRITTEN ONCE PER FRAME IN A RING BUFFER FOR A FEW FRAMES
+    StreamBuffer frameStream(GL_UNIFORM_BUFFER, STREAM_FRAMES * FRAME_VIEWS * (sizeof(FrameUniforms) + 256));
+
     cout << "Starting loading loop" << endl;
 
     //--- TIME MEASUREMENT
@@ -268,7 +527,8 @@ int main()
     while(appState != AppStates::Loaded)
     {
         if(glfwWindowShouldClose(window)) {
-            baseShader.Delete();
+            baseShaders.Delete();
+            frameStream.Delete();
             glfwTerminate();
             return 0;
         }
@@ -291,7 +551,7 @@ int main()
 
         //--- CONTINUE LOADING THE LEVEL
         if(appState == AppStates::LoadingMap) {
-            if(currentCell < content.size()) {
+            if(currentCell < mapRows()) {
                 loadNextRow();
             } else {
                 appState = AppStates::LoadingAABBs;
@@ -310,32 +570,26 @@ int main()
 
         clear();
 
-        baseShader.Use();
-
-        //--- SHADER LOCATIONS
-        vector<GLint> locations;
-        for (string name : locationNames) {
-            locations.push_back(glGetUniformLocation(baseShader.Program, name.c_str()));
-        }
+        //--- PASS VALUES TO SHADER 
+        writeFrameViews(frameStream, projection, view);
+        bindFrameView(frameStream, VIEW_GAME);
 
-        setTexture(COIN_INDEX, locations[LOCATION_REPEAT], 1.0f);
+        useBase(BASE_TEXTURED);
 
-        //--- PASS VALUES TO SHADER 
-        glUniformMatrix4fv(locations[LOCATION_PROJECTION_MATRIX], 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(locations[LOCATION_VIEW_MATRIX], 1, GL_FALSE, glm::value_ptr(view));
+        setMaterial(COIN_INDEX, 1.0f);
         
         //---  SET COIN MATRICES 
         matrices[COIN_INDEX] = glm::mat4(1.0f);
         matrices[COIN_INDEX] = glm::translate(matrices[COIN_INDEX], glm::vec3(0.0f, 0.0f, 0.0f));
         matrices[COIN_INDEX] = glm::rotate(matrices[COIN_INDEX], glm::radians(coinRotationY), glm::vec3(0.0f, 1.0f, 0.0f));
         matrices[COIN_INDEX] = glm::scale(matrices[COIN_INDEX], glm::vec3(0.08f, 0.08f, 0.08f));
-        glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[COIN_INDEX]));
+        glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(matrices[COIN_INDEX]));
 
         //---  DRAW COIN 
-        GLuint vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "standard");
-        glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
         models[COIN_INDEX].Draw();
 
+        frameStream.EndFrame();
+
         glfwSwapBuffers(window);
     }
 
@@ -343,22 +597,27 @@ int main()
 
     //delete &coinModel;
 
-    //---  INIT UNIFORM BUFFER FOR TREES
-    GLint uniformTreesMatrixBlockLocation = glGetUniformBlockIndex(baseShader.Program, "Matrices");
-    glUniformBlockBinding(baseShader.Program, uniformTreesMatrixBlockLocation, 0);
-
-    GLuint uboTreesMatrixBlock;
-    glGenBuffers(1, &uboTreesMatrixBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, uboTreesMatrixBlock);
-    glBufferData(GL_UNIFORM_BUFFER, treesMatrixes.size() * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboTreesMatrixBlock, 0, treesMatrixes.size() * sizeof(glm::mat4));
-
-    //---  FILL UNIFORM BUFFER
-    glBindBuffer(GL_UNIFORM_BUFFER, uboTreesMatrixBlock);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, treesMatrixes.size() * sizeof(glm::mat4), glm::value_ptr(treesMatrixes[0]));
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    //---  SORT THE TREES FOR THE CULLING, THEN FILL THE BUFFER TEXTURE OF THE TREES (READ BY THE TREES VARIANT OF THE
+    //---  BASE SHADER AND BY THE IMPOSTORS)
+    mortonOrderTrees();
+    buildTreesSpheres();
+    treesBuffer.Upload(treesInstances.data(), treesInstances.size());
+    treesBuffer.Bind(TREES_UNIT);
+
+    //--- THE INDEXES OF THE TREES SORTED BY LOD CHANGE EVERY FRAME: THEY ARE WRITTEN IN A RING BUFFER LARGE ENOUGH
+    //--- FOR A FEW FRAMES, READ THROUGH A BUFFER TEXTURE (THE OFFSET OF THE CURRENT FRAME IS ADDED IN drawTrees)
+    StreamBuffer treesLodStream(GL_TEXTURE_BUFFER, STREAM_FRAMES * (treesInstances.size() * sizeof(GLint) + 256));
+    glGenTextures(1, &treesLodTexture);
+    InstanceBuffer::Attach(treesLodTexture, GL_R32I, treesLodStream.Buffer());
+    InstanceBuffer::BindTexture(treesLodTexture, TREES_LOD_UNIT);
+
+    //--- THE COMMANDS OF THE INSTANCED DRAWS ARE BUILT ONCE, EVERY FRAME ONLY CHANGES THEIR INSTANCE COUNTS
+    //--- AND WRITES THEM IN A RING BUFFER
+    for (int lod = 0; lod < models[TREE_INDEX].LodCount(); lod++) {
+        treesDraws.Add(models[TREE_INDEX], lod);
+    }
+    footprintsDraws.Add(models[PLANE_INDEX], 0);
+    StreamBuffer drawStream(GL_DRAW_INDIRECT_BUFFER, STREAM_FRAMES * (treesDraws.Bytes() + footprintsDraws.Bytes() + 2 * 256));
 
     cout << "Starting game loop" << endl;
 
@@ -387,7 +646,7 @@ int main()
     //--- CREATING THE TEXTURES
     GLuint firstTexture;
     glGenTextures(1, &firstTexture);
-    glBindTexture(GL_TEXTURE_2D, firstTexture);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, firstTexture);
 
     //--- PASSING AN EMPTY IMAGE
     glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0,GL_RGB, GL_UNSIGNED_BYTE, 0);
@@ -398,7 +657,7 @@ int main()
 
     GLuint secondTexture;
     glGenTextures(1, &secondTexture);
-    glBindTexture(GL_TEXTURE_2D, secondTexture);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, secondTexture);
 
     //--- PASSING AN EMPTY IMAGE
     glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0,GL_RGB, GL_UNSIGNED_BYTE, 0);
@@ -439,10 +698,20 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        //--- THE GL CALLS ARE COUNTED PER FRAME
+        GLState::Get().ResetCounters();
+
         //---  CHECK INPUT EVENTS 
         glfwPollEvents();
         process_keys(window);
 
+#if defined(MAP_HOT_RELOAD) && !defined(EMBEDDED_MAP)
+        //--- APPLY THE EDITS OF THE MAP FILE
+        if(mapWatcher.changed(currentFrame)) {
+            reloadMap();
+        }
+#endif
+
         clear();
 
         auto start = std::chrono::high_resolution_clock::now();
@@ -541,109 +810,86 @@ int main()
 
         //cout << "Camera collision: " << cameraCollisionµs << "micros\tPlayer collision: " << playerCollisionµs << "micros" << endl;
 
-        //--- USE SHADER 
-        baseShader.Use();
-
-        //--- SHADER LOCATIONS
-        vector<GLint> locations;
-        for (string name : locationNames) {
-            locations.push_back(glGetUniformLocation(baseShader.Program, name.c_str()));
-        }
-
-        glUniform1i(locations[LOCATION_TEXTURE], 1);
-
-        drawPlane(baseShader, projection, view, locations);
+        //--- THE LODS OF THE WHOLE FRAME ARE CHOSEN FROM THE GAME CAMERA
+        updateLodCamera(projection, view);
 
-        GLuint fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "textured");
-        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+        //--- PASS VALUES TO SHADERS: ALL THE PROGRAMS READ THE CAMERA, THE TIME AND THE DISTORSION FROM THE FRAME BLOCK
+        writeFrameViews(frameStream, projection, view);
+        bindFrameView(frameStream, VIEW_GAME);
 
-        //--- SET HOUSE TEXTURE
-        setTexture(HOUSE_INDEX, locations[LOCATION_REPEAT], 1.0f);
-
-        //---  SET HOUSE MATRICES 
-        matrices[HOUSE_INDEX] = glm::mat4(1.0f);
-        matrices[HOUSE_INDEX] = glm::translate(matrices[HOUSE_INDEX], glm::vec3(houseX, 2.8f, houseZ));
-        matrices[HOUSE_INDEX] = glm::rotate(matrices[HOUSE_INDEX], glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        matrices[HOUSE_INDEX] = glm::rotate(matrices[HOUSE_INDEX], glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        matrices[HOUSE_INDEX] = glm::scale(matrices[HOUSE_INDEX], glm::vec3(5.0f, 5.0f, 5.0f));
-        glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[HOUSE_INDEX]));
-
-        //---  DRAW HOUSE 
-        models[HOUSE_INDEX].Draw();
-
-        //--- SET TREE TEXTURE 
-        setTexture(TREE_INDEX, locations[LOCATION_REPEAT], 1.0f);
-
-        //---  DRAW TREE
-        GLuint vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "instancedUbo");
-        glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
-        models[TREE_INDEX].DrawInstanced(treesMatrixes.size());
-
-        drawCart(baseShader, locations, 1.0f, "textured");
-
-        drawPlayer(baseShader, locations, 1.0f);
+        //--- THE CULLING ON THE GPU IS SUBMITTED BEFORE THE OTHER DRAWS: ITS COUNTS ARE READ IN THE NEXT FRAME
+        bool treesCulledOnGpu = gpuCulling;
+        if(treesCulledOnGpu) {
+            cullTreesOnGpu(cullShader);
+        }
 
-        drawBody(baseShader, locations, 1.0f, "textured");
+        //--- OPAQUE DRAWS: SUBMITTED TO THE RENDER QUEUE, SORTED BY PROGRAM, DEPTH (FRONT TO BACK) AND MATERIAL,
+        //--- AND EXECUTED SETTING ONLY THE STATE THAT CHANGES
+        renderQueue.Clear();
+        sceneDraws.clear();
+        submitDraw(BASE_TEXTURED, PLANE_INDEX, matrices[PLANE_INDEX], 80.0f, 0);
+        matrices[HOUSE_INDEX] = houseMatrix();
+        submitDraw(BASE_TEXTURED, HOUSE_INDEX, matrices[HOUSE_INDEX], 1.0f, selectLod(HOUSE_INDEX, matrices[HOUSE_INDEX]));
+        submitTrees();
+        matrices[CART_INDEX] = cartMatrix(1.0f);
+        submitDraw(BASE_TEXTURED, CART_INDEX, matrices[CART_INDEX], 1.0f, selectLod(CART_INDEX, matrices[CART_INDEX]));
+        glm::mat4 player = playerMatrix(1.0f);
+        submitDraw(BASE_TEXTURED, PLAYER_INDEX, player, 1.0f, selectLod(PLAYER_INDEX, player));
+        glm::mat4 body = bodyMatrix(1.0f);
+        submitDraw(BASE_TEXTURED, PLAYER_INDEX, body, 1.0f, selectLod(PLAYER_INDEX, body));
+        executeRenderQueue(impostorShader, treesLodStream, drawStream, treesCulledOnGpu);
 
         if((questState == QuestStates::CartInspected || questState == QuestStates::Odor) && distorsion < 0.0f) {
             pointsShader.Use();
 
-            glUniformMatrix4fv(glGetUniformLocation(pointsShader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(glGetUniformLocation(pointsShader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniform2i(pointsUniforms.Material, materials[ODOR_INDEX].Array, materials[ODOR_INDEX].Layer);
 
-            glUniform1i(glGetUniformLocation(pointsShader.Program, "tex"), 1);
-            glUniform1f(glGetUniformLocation(pointsShader.Program, "time"), glfwGetTime());
-            glUniform1f(glGetUniformLocation(pointsShader.Program, "distorsion"), distorsion);
-            glUniform1i(glGetUniformLocation(pointsShader.Program, "billboard"), 1);
+            //--- CREATE BUFFERS, ONLY THE FIRST TIME
+            if(!pointsVAO) {
+                glGenVertexArrays(1, &pointsVAO);
+                glGenBuffers(1, &pointsVBO);
 
-            //--- CREATE BUFFERS
-            GLuint VAO, VBO;
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
+                //--- ACTIVATE FIRST ATTRIBUTE
+                GLState::Get().BindVertexArray(pointsVAO);
+                GLState::Get().BindBuffer(GL_ARRAY_BUFFER, pointsVBO);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Point), (GLvoid*)0);
+            }
 
             //--- BIND VAO
-            glBindVertexArray(VAO);
-
-            //--- PUT VERTICES IN VBO
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(Point), &points[0], GL_STATIC_DRAW);
+            GLState::Get().BindVertexArray(pointsVAO);
 
-            //--- ACTIVATE FIRST ATTRIBUTE
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Point), (GLvoid*)0);
-
-            //--- SET TEXTURE
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, textures[ODOR_INDEX]);
+            //--- PUT VERTICES IN VBO, ONLY IF THEY HAVE CHANGED
+            if(pointsChanged) {
+                GLState::Get().BindBuffer(GL_ARRAY_BUFFER, pointsVBO);
+                glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(Point), points.data(), GL_STATIC_DRAW);
+                pointsChanged = false;
+            }
 
             //--- DRAW
             glDrawArrays(GL_POINTS, 0, points.size());
         }
 
-        baseShader.Use();
-
         if((questState == QuestStates::BodyInspected && distorsion < 0.0f)) {
             
-            fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "footprint");
-            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+            useBase(BASE_FOOTPRINT);
 
             //--- SET FOOTPRINT TEXTURE 
-            setTexture(FOOTPRINT_INDEX, locations[LOCATION_REPEAT], 1.0f);
+            setMaterial(FOOTPRINT_INDEX, 1.0f);
             
-            //---  DRAW FOOTPRINT
-            GLuint vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "instancedBase");
-            glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
-            glUniformMatrix4fv(glGetUniformLocation(baseShader.Program, "modelMatrices"), footprintsMatrixes.size(), GL_FALSE, glm::value_ptr(footprintsMatrixes[0]));
-
-            models[PLANE_INDEX].DrawInstanced(footprintsMatrixes.size());
+            //--- PUT MATRICES IN THE BUFFER TEXTURE, ONLY IF THEY HAVE CHANGED
+            if(footprintsChanged) {
+                footprintsBuffer.Upload(footprintsInstances.data(), footprintsInstances.size());
+                footprintsBuffer.Bind(FOOTPRINTS_UNIT);
+                footprintsChanged = false;
+            }
 
-            vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "standard");
-            glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
+            //---  DRAW FOOTPRINT
+            footprintsDraws.SetInstances(0, footprintsInstances.size());
+            footprintsDraws.Write(drawStream);
+            footprintsDraws.Submit(0);
         }
 
-        fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "textured");
-        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
-
         //--- CLEAR SECOND TEXTURE OF FRAME BUFFER
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, secondTexture, 0);
         glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
@@ -659,40 +905,37 @@ int main()
                 cout << "With your senses you can now follow their footprints!" << endl;
                 questState = QuestStates::BodyInspected;
             }
-            glColorMask(false, false, false, false);
-            glDepthMask(false);
+            GLState::Get().ColorMask(false, false, false, false);
+            GLState::Get().DepthMask(false);
 
             //--- IN THE FIRST PASS, ALL FRAGMENTS PASS THE STENCIL TEST
             //--- ACTION WHEN STENCIL FAILS, DEPTH FAILS AND BOTH PASS
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilMask(0xFF);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            GLState::Get().StencilFunc(GL_ALWAYS, 1, 0xFF);
+            GLState::Get().StencilMask(0xFF);
 
-            drawBody(baseShader, locations, 1.0f, "textured");
+            drawBody(1.0f, BASE_TEXTURED);
 
             //--- REMOVE PLAYER FROM STENCIL
-            glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
 
-            drawPlayer(baseShader, locations, 1.0f);
+            drawPlayer(1.0f);
 
-            glColorMask(true, true, true, true);
-            glDepthMask(true);
+            GLState::Get().ColorMask(true, true, true, true);
+            GLState::Get().DepthMask(true);
 
-            glStencilMask(0x00);
+            GLState::Get().StencilMask(0x00);
 
             //--- DRAW PLANE ONLY WHERE STENCIL IS !=1
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilFunc(GL_EQUAL, 1, 0xFF);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            GLState::Get().StencilFunc(GL_EQUAL, 1, 0xFF);
 
-            view = glm::lookAt(glm::vec3(0.0f, 1.0f, 7.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            bindFrameView(frameStream, VIEW_SCREEN);
 
-             //--- PASS VALUES TO SHADER 
-            glUniformMatrix4fv(locations[LOCATION_PROJECTION_MATRIX], 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(locations[LOCATION_VIEW_MATRIX], 1, GL_FALSE, glm::value_ptr(view));
+            useBase(BASE_FIXED_COLOR);
 
-            fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "fixedColor");
-            glUniform3fv(locations[LOCATION_COLOR], 1, questState == QuestStates::Odor ? redColor : yellowColor);
-            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+             //--- PASS VALUES TO SHADER 
+            glUniform3fv(baseLocation(LOCATION_COLOR), 1, questState == QuestStates::Odor ? redColor : yellowColor);
 
             glm::mat4 planeModelMatrix2 = glm::mat4(1.0f);
             planeModelMatrix2 = glm::translate(planeModelMatrix2, glm::vec3(0.0f, 1.0f, -10.0f));
@@ -700,14 +943,12 @@ int main()
             planeModelMatrix2 = glm::scale(planeModelMatrix2, glm::vec3(1/16.0f * 17.0f, 1.0f, 1/16.0f * 10.0f));
 
             //---  SET PLANE MATRIX
-            glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
+            glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
 
             //---  DRAW PLANE
-            vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "standard");
-            glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
             models[PLANE_INDEX].Draw();
 
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            GLState::Get().StencilFunc(GL_ALWAYS, 1, 0xFF);
         }
 
         float distancePlayerCart = distance(glm::vec2(playerPos.x, playerPos.z), glm::vec2(cartX, cartZ));
@@ -720,40 +961,37 @@ int main()
                 cout << "With your senses you can now follow the perfume trail!" << endl;
                 questState = QuestStates::CartInspected;
             }
-            glColorMask(false, false, false, false);
-            glDepthMask(false);
+            GLState::Get().ColorMask(false, false, false, false);
+            GLState::Get().DepthMask(false);
 
             //--- IN THE FIRST PASS, ALL FRAGMENTS PASS THE STENCIL TEST
             //--- ACTION WHEN STENCIL FAILS, DEPTH FAILS AND BOTH PASS
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilMask(0xFF);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            GLState::Get().StencilFunc(GL_ALWAYS, 1, 0xFF);
+            GLState::Get().StencilMask(0xFF);
 
-            drawCart(baseShader, locations, 1.0f, "textured");
+            drawCart(1.0f, BASE_TEXTURED);
 
             //--- REMOVE PLAYER FROM STENCIL
-            glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
 
-            drawPlayer(baseShader, locations, 1.0f);
+            drawPlayer(1.0f);
             
-            glColorMask(true, true, true, true);
-            glDepthMask(true);
+            GLState::Get().ColorMask(true, true, true, true);
+            GLState::Get().DepthMask(true);
 
-            glStencilMask(0x00);
+            GLState::Get().StencilMask(0x00);
 
             //--- DRAW PLANE ONLY WHERE STENCIL IS !=1
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilFunc(GL_EQUAL, 1, 0xFF);
+            GLState::Get().StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            GLState::Get().StencilFunc(GL_EQUAL, 1, 0xFF);
 
-            view = glm::lookAt(glm::vec3(0.0f, 1.0f, 7.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            bindFrameView(frameStream, VIEW_SCREEN);
 
-             //--- PASS VALUES TO SHADER 
-            glUniformMatrix4fv(locations[LOCATION_PROJECTION_MATRIX], 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(locations[LOCATION_VIEW_MATRIX], 1, GL_FALSE, glm::value_ptr(view));
+            useBase(BASE_FIXED_COLOR);
 
-            fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "fixedColor");
-            glUniform3fv(locations[LOCATION_COLOR], 1, questState == QuestStates::Cart ? redColor : yellowColor);
-            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+             //--- PASS VALUES TO SHADER 
+            glUniform3fv(baseLocation(LOCATION_COLOR), 1, questState == QuestStates::Cart ? redColor : yellowColor);
 
             glm::mat4 planeModelMatrix2 = glm::mat4(1.0f);
             planeModelMatrix2 = glm::translate(planeModelMatrix2, glm::vec3(0.0f, 1.0f, -10.0f));
@@ -761,14 +999,12 @@ int main()
             planeModelMatrix2 = glm::scale(planeModelMatrix2, glm::vec3(1/16.0f * 17.0f, 1.0f, 1/16.0f * 10.0f));
 
             //---  SET PLANE MATRIX
-            glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
+            glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
 
             //---  DRAW PLANE
-            vertSubIndex = glGetSubroutineIndex(baseShader.Program, GL_VERTEX_SHADER, "standard");
-            glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
             models[PLANE_INDEX].Draw();
 
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            GLState::Get().StencilFunc(GL_ALWAYS, 1, 0xFF);
         }
 
         //--- BIND BACK TO FIRST TEXTURE
@@ -781,18 +1017,13 @@ int main()
 
         clear();
 
-        view = glm::lookAt(glm::vec3(0.0f, 1.0f, 7.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-        fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "pincushion");
-        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+        bindFrameView(frameStream, VIEW_SCREEN);
 
-        //--- PASS VALUES TO SHADER 
-        glUniformMatrix4fv(locations[LOCATION_PROJECTION_MATRIX], 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(locations[LOCATION_VIEW_MATRIX], 1, GL_FALSE, glm::value_ptr(view));
+        useBase(BASE_PINCUSHION);
 
         //--- SET PLANE TEXTURE 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, firstTexture);
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, firstTexture);
         
         glm::mat4 planeModelMatrix2 = glm::mat4(1.0f);
         planeModelMatrix2 = glm::translate(planeModelMatrix2, glm::vec3(0.0f, 1.0f, -10.0f));
@@ -800,17 +1031,16 @@ int main()
         planeModelMatrix2 = glm::scale(planeModelMatrix2, glm::vec3(1/16.0f * 17.0f, 1.0f, 1/16.0f * 10.0f));
 
         //---  SET PLANE MATRIX
-        glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
+        glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(planeModelMatrix2));
 
         //---  DRAW PLANE 
         models[PLANE_INDEX].Draw();
 
         //--- SET PLANE TEXTURE 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, secondTexture);
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, secondTexture);
 
-        fragmSubIndex = glGetSubroutineIndex(baseShader.Program, GL_FRAGMENT_SHADER, "tracePlane");
-        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &fragmSubIndex);
+        useBase(BASE_TRACE_PLANE);
         
         glm::mat4 planeModelMatrix3 = glm::mat4(1.0f);
         planeModelMatrix3 = glm::translate(planeModelMatrix3, glm::vec3(0.0f, 1.0f, -9.95f));
@@ -818,17 +1048,48 @@ int main()
         planeModelMatrix3 = glm::scale(planeModelMatrix3, glm::vec3(1/16.0f * 17.0f, 1.0f, 1/16.0f * 10.0f));
 
         //---  SET PLANE MATRIX
-        glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(planeModelMatrix3));
+        glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(planeModelMatrix3));
 
         //---  DRAW PLANE 
         models[PLANE_INDEX].Draw();
 
+        //--- THE RANGES OF THE STREAM BUFFERS WRITTEN IN THIS FRAME ARE REUSED AFTER THE GPU HAS READ THEM
+        treesLodStream.EndFrame();
+        frameStream.EndFrame();
+        drawStream.EndFrame();
+
+        //--- GL CALLS OF THE FRAME (SWITCHED WITH I), PRINTED ONCE PER SECOND
+        if(showGLCalls && currentFrame - lastGLCallsPrint >= 1.0f) {
+            cout << "GL calls of the frame: " << GLState::Get().Issued() << " issued, " << GLState::Get().Skipped() << " skipped" << endl;
+            lastGLCallsPrint = currentFrame;
+        }
+
         //--- SWAP BUFFERS
         glfwSwapBuffers(window);
     }
 
     //--- DELETE USED SHADERS
-    baseShader.Delete();
+    baseShaders.Delete();
+    cullShader.Delete();
+
+    //--- DELETE THE BUFFERS CREATED FOR THE GAME LOOP
+    treesLodStream.Delete();
+    frameStream.Delete();
+    drawStream.Delete();
+    treesBuffer.Delete();
+    footprintsBuffer.Delete();
+    GLState::Get().DeleteTextures(1, &treesLodTexture);
+    treesCullBuffer.Delete();
+    for (CullFrame& frame : cullFrames) {
+        glDeleteQueries(MAX_LODS + 1, frame.Queries);
+    }
+    GLState::Get().DeleteVertexArrays(1, &cullVAO);
+    materialArrays.Delete();
+    uploadPool.Delete();
+    if(pointsVAO) {
+        GLState::Get().DeleteVertexArrays(1, &pointsVAO);
+        GLState::Get().DeleteBuffers(1, &pointsVBO);
+    }
     
     //--- CLOSE AND DELETE CONTEXT
     glfwTerminate();
@@ -845,6 +1106,17 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    //--- G SWITCHES THE CULLING OF THE TREES BETWEEN THE CPU AND THE GPU
+    if(key == GLFW_KEY_G && action == GLFW_PRESS) {
+        gpuCulling = !gpuCulling;
+        cout << "Trees culled on the " << (gpuCulling ? "GPU" : "CPU") << endl;
+    }
+
+    //--- I SWITCHES THE PRINT OF THE GL CALLS OF THE FRAME
+    if(key == GLFW_KEY_I && action == GLFW_PRESS) {
+        showGLCalls = !showGLCalls;
+    }
+
     if(action == GLFW_PRESS) {
         keys[key] = true;
     }
@@ -919,41 +1191,68 @@ void process_keys(GLFWwindow* window) {
     }
 }
 
-GLint LoadTexture(const char* path)
+//--- CPU SIDE OF THE LOADING OF A TEXTURE, IT CAN RUN ON A WORKER THREAD
+TextureData decodeTexture(string path)
 {
-    GLuint textureImage;
-    int w, h, channels;
-    unsigned char* image;
-    image = stbi_load(path, &w, &h, &channels, STBI_rgb);
-    if (image == nullptr) {
-        std::cout << "Failed to load texture!" << std::endl;
-    }
-
-    glGenTextures(1, &textureImage);
-    glBindTexture(GL_TEXTURE_2D, textureImage);
+    TextureData data;
 
-    // 3 channels = RGB ; 4 channel = RGBA
-    if (channels == 3) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+    //--- BAKED TEXTURE: THE MIP CHAIN IS ALREADY COMPRESSED, NO DECODING AND NO MIPMAP GENERATION
+    TextureCache cache(path);
+    if (compressedTextures && cache.Read(data.Compressed)) {
+        return data;
     }
-    else if (channels == 4) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+
+    data.Pixels = stbi_load(path.c_str(), &data.Width, &data.Height, &data.Channels, STBI_rgb);
+    if (data.Pixels == nullptr) {
+        std::cout << "Failed to load texture!" << std::endl;
+        return data;
     }
-    glGenerateMipmap(GL_TEXTURE_2D);
-    // we set how to consider UVs outside [0,1] range
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // we set the filtering for minification and magnification
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST_MIPMAP_NEAREST);
 
-    // we free the memory once we have created an OpenGL texture
-    stbi_image_free(image);
+    //--- FIRST LAUNCH: BAKE THE TEXTURE FOR THE NEXT ONES AND USE THE COMPRESSED VERSION ALREADY
+    if (compressedTextures) {
+        cout << "Baking texture " << path << endl;
+        //--- STBI_rgb ALWAYS RETURNS 3 CHANNELS
+        cache.Bake(data.Pixels, data.Width, data.Height, data.Compressed);
+        stbi_image_free(data.Pixels);
+        data.Pixels = nullptr;
+    }
 
-    // we set the binding to 0 once we have finished
-    glBindTexture(GL_TEXTURE_2D, 0);
+    return data;
+}
 
-    return textureImage;
+//--- THE TEXTURES ARE UPLOADED IN THE LAYERS OF THE ARRAYS OF THEIR SIZE, THEN THE ARRAYS ARE BOUND ONCE
+void uploadMaterials(vector<TextureData>& decoded)
+{
+    materials.resize(decoded.size());
+    for (size_t i = 0; i < decoded.size(); i++) {
+        TextureData& data = decoded[i];
+        if (!data.Compressed.Levels.empty()) {
+            materials[i] = materialArrays.Reserve(data.Compressed.Width, data.Compressed.Height, true, data.Compressed.Levels.size());
+        } else if (data.Pixels) {
+            int levels = (int)floor(log2(max(data.Width, data.Height))) + 1;
+            materials[i] = materialArrays.Reserve(data.Width, data.Height, false, levels);
+        }
+    }
+    materialArrays.Allocate();
+
+    for (size_t i = 0; i < decoded.size(); i++) {
+        TextureData& data = decoded[i];
+        if (!data.Compressed.Levels.empty()) {
+            materialArrays.Upload(materials[i], data.Compressed, uploadPool);
+            data.Compressed.Levels.clear();
+        } else if (data.Pixels) {
+            //--- STBI_rgb ALWAYS RETURNS 3 CHANNELS
+            materialArrays.Upload(materials[i], data.Pixels, data.Width, data.Height, uploadPool);
+            stbi_image_free(data.Pixels);
+            data.Pixels = nullptr;
+        }
+        //--- A TEXTURE WITHOUT A LAYER IS NOT UPLOADED, ITS MODEL IS DRAWN WITH THE FIRST MATERIAL
+        if (!materials[i].IsValid()) {
+            materials[i] = Material();
+        }
+    }
+    materialArrays.GenerateMipmaps();
+    materialArrays.Bind();
 }
 
 ///////////////////////////////////////
@@ -973,15 +1272,112 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 }
 
 void clear() {
-    glStencilMask(0xFF);
+    GLState::Get().StencilMask(0xFF);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glStencilMask(0x00);
+    GLState::Get().StencilMask(0x00);
+}
+
+//--- KHR_parallel_shader_compile IS NOT PART OF THE CORE PROFILE LOADED BY GLAD
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+//--- LETS THE DRIVER COMPILE ON ITS OWN THREADS (SOME DRIVERS DO IT ANYWAY WHEN THE STATUS IS NOT READ RIGHT AWAY)
+void enableParallelShaderCompile() {
+    const char* extensions[] = { "GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile" };
+    const char* functions[] = { "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB" };
+    for (int i = 0; i < 2; i++) {
+        if (!glfwExtensionSupported(extensions[i])) {
+            continue;
+        }
+        PFNGLMAXSHADERCOMPILERTHREADSPROC maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)glfwGetProcAddress(functions[i]);
+        if (maxShaderCompilerThreads) {
+            //--- 0xFFFFFFFF: AS MANY THREADS AS THE DRIVER WANTS
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            return;
+        }
+    }
+}
+
+//--- COMPILES THE VARIANTS OF THE BASE SHADER AND READS THEIR LOCATIONS.
+//--- THE UNIFORMS THAT NEVER CHANGE (THE TEXTURE UNITS) ARE SET HERE, ONCE FOR EACH VARIANT
+void initBasePrograms(ShaderPermutations& baseShaders) {
+    //--- ALL THE VARIANTS ARE SUBMITTED BEFORE READING THE FIRST ONE, SO THE DRIVER CAN COMPILE THEM TOGETHER
+    for (int variant = 0; variant < BASE_VARIANTS; variant++) {
+        basePrograms[variant].Program = &baseShaders.Get(baseVariantDefines[variant]);
+    }
+
+    for (int variant = 0; variant < BASE_VARIANTS; variant++) {
+        BaseProgram& base = basePrograms[variant];
+        base.Locations.clear();
+        for (string name : locationNames) {
+            base.Locations.push_back(base.Program->Uniform(name));
+        }
+
+        base.Program->Use();
+        glUniform1i(base.Locations[LOCATION_TEXTURE], 1);
+        MaterialArrays::SetSamplers(*base.Program);
+        bindFrameBlock(*base.Program);
+        //--- EACH INSTANCED VARIANT READS ITS OWN INSTANCES
+        glUniform1i(base.Locations[LOCATION_INSTANCES], variant == BASE_FOOTPRINT ? FOOTPRINTS_UNIT : TREES_UNIT);
+        glUniform1i(base.Locations[LOCATION_TREE_INSTANCES], TREES_LOD_UNIT);
+    }
+}
+
+//--- ACTIVATES A VARIANT OF THE BASE SHADER (THE CAMERA COMES FROM THE BOUND FRAME VIEW)
+void useBase(BaseVariant variant) {
+    basePrograms[variant].Program->Use();
+    currentBase = variant;
 }
 
-void setTexture(int index, GLint repeatLocation, float repeatValue) {
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textures[index]);
-    glUniform1f(repeatLocation, repeatValue);
+//--- LOCATION IN THE VARIANT IN USE
+GLint baseLocation(int location) {
+    return basePrograms[currentBase].Locations[location];
+}
+
+//--- CAMERA OF THE QUADS DRAWN IN SCREEN SPACE
+glm::mat4 screenView() {
+    return glm::lookAt(glm::vec3(0.0f, 1.0f, 7.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+//--- WRITES THE CONSTANTS OF ALL THE VIEWS OF THE FRAME, ONCE
+void writeFrameViews(StreamBuffer& frameStream, glm::mat4 projection, glm::mat4 gameView) {
+    glm::mat4 views[FRAME_VIEWS] = { gameView, screenView() };
+    for (int i = 0; i < FRAME_VIEWS; i++) {
+        FrameUniforms frame;
+        frame.ProjectionMatrix = projection;
+        frame.ViewMatrix = views[i];
+        frame.CameraPosition = glm::inverse(views[i])[3];
+        frame.Time = glfwGetTime();
+        frame.Distorsion = distorsion;
+        frameViewOffsets[i] = frameStream.Write(&frame, sizeof(FrameUniforms));
+    }
+}
+
+//--- ALL THE PROGRAMS READ THE VIEW BOUND HERE, UNTIL THE NEXT CALL
+void bindFrameView(StreamBuffer& frameStream, FrameView frameView) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameStream.Buffer(), frameViewOffsets[frameView], sizeof(FrameUniforms));
+}
+
+//--- HANDLES OF THE UNIFORMS USED IN THE FRAME LOOP
+void resolveShaderHandles(Shader& pointsShader, Shader& impostorShader, Shader& cullShader) {
+    pointsUniforms.Material = pointsShader.Uniform("material");
+    impostorUniforms.InstanceOffset = impostorShader.Uniform("instanceOffset");
+    cullUniforms.FrustumPlanes = cullShader.Uniform("frustumPlanes");
+    cullUniforms.LodPixelsPerUnit = cullShader.Uniform("lodPixelsPerUnit");
+    cullUniforms.CullLod = cullShader.Uniform("cullLod");
+
+    bindFrameBlock(pointsShader);
+    bindFrameBlock(impostorShader);
+    bindFrameBlock(cullShader);
+
+    impostorShader.Use();
+    glUniform1i(impostorShader.Uniform("instances"), TREES_UNIT);
+    glUniform1i(impostorShader.Uniform("treeInstances"), TREES_LOD_UNIT);
+}
+
+//--- NO TEXTURE BIND: THE ARRAYS ARE ALWAYS BOUND, THE SHADER IS TOLD WHICH LAYER TO SAMPLE
+void setMaterial(int index, float repeatValue) {
+    glUniform2i(baseLocation(LOCATION_MATERIAL), materials[index].Array, materials[index].Layer);
+    glUniform1f(baseLocation(LOCATION_REPEAT), repeatValue);
 }
 
 double random() {
@@ -1051,12 +1447,8 @@ void createFootprintsPath() {
     footprintsPoints.push_back(last);
 
     Point firstPoint = footprintsPoints[0];
-    glm::mat4 footprintMatrix = glm::mat4(1.0f);
-    footprintMatrix = glm::translate(footprintMatrix, glm::vec3(firstPoint.Position.x, 0.1f, firstPoint.Position.z));
     float rotation = bearing(firstPoint.Position.x, firstPoint.Position.z, footprintsPoints[1].Position.x, footprintsPoints[1].Position.z);
-    footprintMatrix = glm::rotate(footprintMatrix, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
-    footprintMatrix = glm::scale(footprintMatrix, glm::vec3(0.03f, 1.0f, 0.03f));
-    footprintsMatrixes.push_back(footprintMatrix);
+    footprintsInstances.push_back(Instance::Make(glm::vec3(firstPoint.Position.x, 0.1f, firstPoint.Position.z), glm::radians(rotation), 0.03f));
     Point prevPoint = firstPoint;
     for (std::size_t i = 1; i != footprintsPoints.size() - 1; ++i) {
         Point point = footprintsPoints[i];
@@ -1064,14 +1456,11 @@ void createFootprintsPath() {
             continue;
         }
         cout << point.Position.x << " -- " << point.Position.z << endl;
-        glm::mat4 footprintMatrix = glm::mat4(1.0f);
-        footprintMatrix = glm::translate(footprintMatrix, glm::vec3(point.Position.x, 0.1f, point.Position.z));
         float rotation = bearing(point.Position.x, point.Position.z, footprintsPoints[i+1].Position.x, footprintsPoints[i+1].Position.z);
-        footprintMatrix = glm::rotate(footprintMatrix, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
-        footprintMatrix = glm::scale(footprintMatrix, glm::vec3(0.03f, 1.0f, 0.03f));
-        footprintsMatrixes.push_back(footprintMatrix);
+        footprintsInstances.push_back(Instance::Make(glm::vec3(point.Position.x, 0.1f, point.Position.z), glm::radians(rotation), 0.03f));
         prevPoint = point;
     }
+    footprintsChanged = true;
 }
 
 void interpolateOdorPath() {
@@ -1110,6 +1499,7 @@ void interpolateOdorPath() {
     Point last = Point();
     last.Position = glm::vec3(odor[numPoints - 1].x, 0.0f, odor[numPoints - 1].y);
     points.push_back(last);
+    pointsChanged = true;
 }
 
 void addToAABBsHierarchy(vector<AABB> AABBlist) {
@@ -1122,154 +1512,695 @@ void addToAABBsHierarchy(vector<AABB> AABBlist) {
 
 void loadAABBs() {
     cout << "Calculating AABBs" << endl;
-    for (auto i=treesMatrixes.begin(); i!=treesMatrixes.end(); ++i) {
-        glm::mat4 matrix = *i;
-        glm::vec3 treePos = glm::vec3(matrix[3].x, matrix[3].y, matrix[3].z);
-        float treeSize = matrix[0].x / 1.5f;
-        GLfloat dy = 5.0f * treeSize;
-        AABB aabb = AABB(VerticesBuilder().build(treePos, dy, glm::vec3(treeSize)));
-        AABBs.push_back(aabb);
+    for (auto i=treesInstances.begin(); i!=treesInstances.end(); ++i) {
+        AABBs.push_back(buildTreeAABB(*i));
     }
 
+    AABBs.push_back(buildCartAABB());
+    AABBs.push_back(buildHouseAABB());
+
+    appState = AppStates::CreatingAABBsHierarchy;
+}
+
+AABB buildTreeAABB(const Instance& tree) {
+    glm::vec3 treePos = tree.Position;
+    float treeSize = tree.Scale() / 1.5f;
+    GLfloat dy = 5.0f * treeSize;
+    return AABB(VerticesBuilder().build(treePos, dy, glm::vec3(treeSize)));
+}
+
+AABB buildCartAABB() {
     glm::vec3 cartPos = glm::vec3(cartX, 0.0f, cartZ);
     float dy = 2.0f;
     glm::vec3 cartSize = glm::vec3(1.75f, 0.0f, 1.25f);
-    AABB aabb = AABB(VerticesBuilder().build(cartPos, dy, cartSize));
-    AABBs.push_back(aabb);
+    return AABB(VerticesBuilder().build(cartPos, dy, cartSize));
+}
 
+AABB buildHouseAABB() {
     glm::vec3 housePos = glm::vec3(houseX, 0.0f, houseZ);
+    float dy = 2.0f;
     glm::vec3 houseSize = glm::vec3(2.75f, 1.0f, 4.0f);
-    AABB houseAABB = AABB(VerticesBuilder().build(housePos, dy, houseSize));
-    AABBs.push_back(houseAABB);
+    return AABB(VerticesBuilder().build(housePos, dy, houseSize));
+}
 
-    appState = AppStates::CreatingAABBsHierarchy;
+int mapRows() {
+#ifdef EMBEDDED_MAP
+    return content.Rows;
+#else
+    return content.size();
+#endif
 }
 
 void loadNextRow() {
     cout << "Loading map row #" << currentCell << endl;
+#ifdef EMBEDDED_MAP
+    //--- SPECIAL OBJECTS COME FROM THE TABLE, ALL AT ONCE WITH THE FIRST ROW
+    if(currentCell == 0) {
+        for(int i = 0; i < content.SpecialsCount; i++) {
+            const MapSpecial& special = content.Specials[i];
+            loadCell(special.Type, special.Order, special.Row, special.Column);
+        }
+    }
+    for(int column = 0; column < MAP_MAX_COLUMNS; column++) {
+        const MapTile& tile = content.Tiles[currentCell][column];
+        if(tile.Type == 'T' || tile.Type == 'P') {
+            loadCell(tile.Type, tile.Order, currentCell, column);
+        }
+    }
+#else
     for (auto i=content[currentCell].begin(); i!=content[currentCell].end(); ++i) {
-        float position = i-content[currentCell].begin();
-        if(*i == "T") {
-            //--- TREES ARE RANDOMLY DISPLACED FROM THEIR 0.5x0.5 cell by a random value between -0.5f and 0.5f
-            float randX = (rand() % 10 - 5) / 10.f;
-            float randZ = (rand() % 10 - 5) / 10.f;
-            //--- TREES ARE RANDOMLY SCALED FROM 100% TO 150%
-            float randomScale = (100 + (rand() % 50)) / 100.f;
-            glm::mat4 treeMatrix = glm::mat4(1.0f);
-            treeMatrix = glm::translate(treeMatrix, glm::vec3(currentCell * 2 + 0.5 + randX, 0.0f, position * 2 + 0.5f + randZ));
-            treeMatrix = glm::scale(treeMatrix, glm::vec3(randomScale, randomScale, randomScale));
-            treesMatrixes.push_back(treeMatrix);
+        int position = i-content[currentCell].begin();
+        char type = (*i).empty() ? 0 : (*i)[0];
+        int order = type == 'F' ? stoi((*i).substr(1)) : 0;
+        loadCell(type, order, currentCell, position);
+    }
+#endif
+}
+
+void loadCell(char type, int order, int row, int column) {
+    float position = column;
+    if(type == 'T') {
+        //--- TREES ARE RANDOMLY DISPLACED FROM THEIR 0.5x0.5 cell by a random value between -0.5f and 0.5f
+        float randX = (rand() % 10 - 5) / 10.f;
+        float randZ = (rand() % 10 - 5) / 10.f;
+        //--- TREES ARE RANDOMLY SCALED FROM 100% TO 150%
+        float randomScale = (100 + (rand() % 50)) / 100.f;
+        treesInstances.push_back(Instance::Make(glm::vec3(row * 2 + 0.5 + randX, 0.0f, position * 2 + 0.5f + randZ), 0.0f, randomScale));
+        treesCells.push_back(glm::ivec2(row, column));
+    }
+    if(type == 'D') {
+        bodyX = row * 2;
+        bodyZ = position * 2;
+    }
+    if(type == 'S') {
+        deltaX = row * 2;
+        deltaZ = position * 2;
+    }
+    if(type == 'C') {
+        cartX = row * 2;
+        cartZ = position * 2;
+    }
+    if(type == 'H') {
+        houseX = row * 2;
+        houseZ = position * 2;
+    }
+    if(type == 'P') {
+        paths.push_back(glm::vec2(row, position));
+    }
+    if(type == 'O') {
+        odor.push_back(glm::vec2(row * 2, position * 2));
+    }
+    if(type == 'F') {
+        Footprint f = Footprint();
+        f.Position = glm::vec2(row * 2, position * 2);
+        f.Order = order;
+        footprints.push_back(f);
+    }
+}
+
+#if defined(MAP_HOT_RELOAD) && !defined(EMBEDDED_MAP)
+string cellAt(vector<vector<string>>& grid, size_t row, size_t column) {
+    if(row < grid.size() && column < grid[row].size()) {
+        return grid[row][column];
+    }
+    return "";
+}
+
+int cellKey(glm::ivec2 cell) {
+    return cell.x * 65536 + cell.y;
+}
+
+//--- REMOVES A TREE BY MOVING THE LAST ONE IN ITS SLOT, SO ONLY ONE INSTANCE HAS TO BE UPLOADED AGAIN
+void removeTree(int index, unordered_map<int, int>& treeByCell, set<int>& dirtyTrees) {
+    AABB aabb = buildTreeAABB(treesInstances[index]);
+    AABBhierarchy.removeAABBFromHierarchy(aabb);
+
+    treeByCell.erase(cellKey(treesCells[index]));
+    int last = treesInstances.size() - 1;
+    if(index != last) {
+        treesInstances[index] = treesInstances[last];
+        treesCells[index] = treesCells[last];
+        treeByCell[cellKey(treesCells[index])] = index;
+        dirtyTrees.insert(index);
+    }
+    treesInstances.pop_back();
+    treesCells.pop_back();
+    dirtyTrees.erase(last);
+}
+
+//--- A FOOTPRINT CELL IS F FOLLOWED BY ITS ORDER IN THE PATH
+bool isFootprintCell(const string& cell) {
+    if(cell.size() < 2) {
+        return false;
+    }
+    for (std::size_t i = 1; i != cell.size(); ++i) {
+        if(!isdigit((unsigned char)cell[i])) {
+            return false;
         }
-        if(*i == "D") {
-            bodyX = currentCell * 2;
-            bodyZ = position * 2;
+    }
+    return true;
+}
+
+//--- A MAP READ WHILE THE EDITOR IS SAVING IT (OR WHILE A NUMBER IS BEING TYPED) CAN BE CUT OR INCOMPLETE:
+//--- IT MUST HAVE THE ROWS OF THE LOADED ONE, ALL WITH THE SAME COLUMNS, AND A NUMBER AFTER EVERY F
+bool isCompleteMap(vector<vector<string>>& newContent) {
+    if(newContent.empty() || newContent.size() != content.size()) {
+        return false;
+    }
+    for (std::size_t row = 0; row != newContent.size(); ++row) {
+        if(newContent[row].size() != newContent[0].size()) {
+            return false;
         }
-        if(*i == "S") {
-            deltaX = currentCell * 2;
-            deltaZ = position * 2;
+        for (const string& cell : newContent[row]) {
+            if(!cell.empty() && cell[0] == 'F' && !isFootprintCell(cell)) {
+                return false;
+            }
         }
-        if(*i == "C") {
-            cartX = currentCell * 2;
-            cartZ = position * 2;
+    }
+    return true;
+}
+
+//--- DIFF THE NEW MAP AGAINST THE LOADED ONE AND UPDATE ONLY THE CHANGED CELLS:
+//--- TREE INSTANCES AND THEIR COLLIDERS, CART/HOUSE/BODY POSITIONS AND THE ODOR/FOOTPRINTS PATHS
+void reloadMap() {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    vector<vector<string>> newContent;
+    if(!CsvLoader().tryRead(MAP_PATH, newContent)) {
+        return;
+    }
+    //--- THE OLD MAP IS KEPT, THE NEXT SAVE WILL BE CHECKED AGAIN
+    if(!isCompleteMap(newContent)) {
+        cout << "Map not reloaded: incomplete or malformed file" << endl;
+        return;
+    }
+
+    //--- INDEX OF THE TREES BY CELL
+    unordered_map<int, int> treeByCell;
+    for (std::size_t i = 0; i != treesCells.size(); ++i) {
+        treeByCell[cellKey(treesCells[i])] = i;
+    }
+
+    set<int> dirtyTrees;
+    AABB oldCart = buildCartAABB();
+    AABB oldHouse = buildHouseAABB();
+    bool cartMoved = false;
+    bool houseMoved = false;
+    bool pathsChanged = false;
+    int changedCells = 0;
+
+    size_t rows = max(content.size(), newContent.size());
+    for (std::size_t row = 0; row != rows; ++row) {
+        size_t columns = max(row < content.size() ? content[row].size() : 0, row < newContent.size() ? newContent[row].size() : 0);
+        for (std::size_t column = 0; column != columns; ++column) {
+            string before = cellAt(content, row, column);
+            string after = cellAt(newContent, row, column);
+            if(before == after) {
+                continue;
+            }
+            changedCells++;
+            char oldType = before.empty() ? 0 : before[0];
+            char newType = after.empty() ? 0 : after[0];
+
+            //--- TREES
+            if(oldType == 'T') {
+                auto tree = treeByCell.find(cellKey(glm::ivec2(row, column)));
+                if(tree != treeByCell.end()) {
+                    removeTree(tree->second, treeByCell, dirtyTrees);
+                }
+            }
+            if(newType == 'T') {
+                loadCell(newType, 0, row, column);
+                int index = treesInstances.size() - 1;
+                AABB aabb = buildTreeAABB(treesInstances[index]);
+                AABBhierarchy.addAABBToHierarchy(aabb);
+                treeByCell[cellKey(treesCells[index])] = index;
+                dirtyTrees.insert(index);
+            }
+
+            //--- SINGLE OBJECTS ARE MOVED WHEN THEY APPEAR IN A NEW CELL
+            if(newType == 'C' || newType == 'H' || newType == 'D') {
+                loadCell(newType, 0, row, column);
+                cartMoved = cartMoved || newType == 'C';
+                houseMoved = houseMoved || newType == 'H';
+            }
+
+            //--- PATHS ARE REBUILT IF ANY OF THEIR CELLS CHANGED
+            if(oldType == 'O' || oldType == 'F' || oldType == 'P' || newType == 'O' || newType == 'F' || newType == 'P') {
+                pathsChanged = true;
+            }
         }
-        if(*i == "H") {
-            houseX = currentCell * 2;
-            houseZ = position * 2;
+    }
+
+    if(cartMoved) {
+        AABBhierarchy.removeAABBFromHierarchy(oldCart);
+        AABB aabb = buildCartAABB();
+        AABBhierarchy.addAABBToHierarchy(aabb);
+    }
+
+    if(houseMoved) {
+        AABBhierarchy.removeAABBFromHierarchy(oldHouse);
+        AABB aabb = buildHouseAABB();
+        AABBhierarchy.addAABBToHierarchy(aabb);
+    }
+
+    if(pathsChanged) {
+        paths.clear();
+        odor.clear();
+        footprints.clear();
+        for (std::size_t row = 0; row != newContent.size(); ++row) {
+            for (std::size_t column = 0; column != newContent[row].size(); ++column) {
+                string cell = newContent[row][column];
+                char type = cell.empty() ? 0 : cell[0];
+                if(type == 'O' || type == 'P' || type == 'F') {
+                    loadCell(type, type == 'F' ? stoi(cell.substr(1)) : 0, row, column);
+                }
+            }
         }
-        if(*i == "P") {
-            paths.push_back(glm::vec2(currentCell, position));
+        points.clear();
+        pointsChanged = true;
+        footprintsPoints.clear();
+        footprintsInstances.clear();
+        footprintsChanged = true;
+        //--- BOTH PATHS ARE SPLINES, THEY NEED AT LEAST TWO POINTS
+        if(odor.size() >= 2) {
+            interpolateOdorPath();
         }
-        if(*i == "O") {
-            odor.push_back(glm::vec2(currentCell * 2, position * 2));
+        if(footprints.size() >= 2) {
+            createFootprintsPath();
         }
-        if((*i).find("F") != std::string::npos) {
-            Footprint f = Footprint();
-            f.Position = glm::vec2(currentCell * 2, position * 2);
-            f.Order = stoi((*i).substr(1));
-            footprints.push_back(f);
+    }
+
+    //--- UPLOAD ONLY THE CHANGED INSTANCES, MERGING CONTIGUOUS ONES IN A SINGLE RANGE
+    //--- (ALL OF THEM IF THE BUFFER HAS GROWN, ITS OLD CONTENT IS LOST)
+    int ranges = 0;
+    if(treesBuffer.Reserve(treesInstances.size())) {
+        treesBuffer.Update(treesInstances.data(), 0, treesInstances.size());
+        dirtyTrees.clear();
+        ranges++;
+    }
+    for (auto i=dirtyTrees.begin(); i!=dirtyTrees.end(); ) {
+        int first = *i;
+        int last = first;
+        ++i;
+        while(i != dirtyTrees.end() && *i == last + 1) {
+            last = *i;
+            ++i;
         }
+        treesBuffer.Update(&treesInstances[first], first, last - first + 1);
+        ranges++;
     }
+    buildTreesSpheres();
+
+    content = newContent;
+
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    cout << "Map reloaded: " << changedCells << " changed cells, " << ranges << " uploaded ranges in " << microseconds << "micros" << endl;
+}
+#endif
+
+glm::mat4 playerMatrix(float scaleModifier) {
+    glm::mat4 matrix = glm::mat4(1.0f);
+    matrix = glm::translate(matrix, glm::vec3(deltaX, 0.0f, deltaZ));
+    matrix = glm::rotate(matrix, glm::radians(rotationY), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(matrix, glm::vec3(0.03f * scaleModifier, 0.03f * scaleModifier, 0.03f * scaleModifier));
 }
 
-void drawPlayer(Shader shader, vector<GLint> locations, float scaleModifier) {
+glm::mat4 bodyMatrix(float scaleModifier) {
+    glm::mat4 matrix = glm::mat4(1.0f);
+    matrix = glm::translate(matrix, glm::vec3(bodyX, 0.0f, bodyZ));
+    matrix = glm::rotate(matrix, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    return glm::scale(matrix, glm::vec3(0.03f * scaleModifier, 0.03f * scaleModifier, 0.03f * scaleModifier));
+}
+
+glm::mat4 cartMatrix(float scaleModifier) {
+    glm::mat4 matrix = glm::mat4(1.0f);
+    matrix = glm::translate(matrix, glm::vec3(cartX, 0.0f, cartZ));
+    return glm::scale(matrix, glm::vec3(1.25f * scaleModifier, 1.25f * scaleModifier, 1.25f * scaleModifier));
+}
+
+glm::mat4 houseMatrix() {
+    glm::mat4 matrix = glm::mat4(1.0f);
+    matrix = glm::translate(matrix, glm::vec3(houseX, 2.8f, houseZ));
+    matrix = glm::rotate(matrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    matrix = glm::rotate(matrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    return glm::scale(matrix, glm::vec3(5.0f, 5.0f, 5.0f));
+}
+
+void drawPlayer(float scaleModifier) {
     //--- DRAW PLAYER
-    GLuint subroutineIndex = glGetSubroutineIndex(shader.Program, GL_FRAGMENT_SHADER, "textured");
-    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subroutineIndex);
+    useBase(BASE_TEXTURED);
 
     //--- SET PLAYER TEXTURE 
-    setTexture(PLAYER_INDEX, locations[LOCATION_REPEAT], 1.0f);
+    setMaterial(PLAYER_INDEX, 1.0f);
 
     //---  SET PLAYER MATRICES 
-    matrices[PLAYER_INDEX] = glm::mat4(1.0f);
-    matrices[PLAYER_INDEX] = glm::translate(matrices[PLAYER_INDEX], glm::vec3(deltaX, 0.0f, deltaZ));
-    matrices[PLAYER_INDEX] = glm::rotate(matrices[PLAYER_INDEX], glm::radians(rotationY), glm::vec3(0.0f, 1.0f, 0.0f));
-    matrices[PLAYER_INDEX] = glm::scale(matrices[PLAYER_INDEX], glm::vec3(0.03f * scaleModifier, 0.03f * scaleModifier, 0.03f * scaleModifier));
-    glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[PLAYER_INDEX]));
+    matrices[PLAYER_INDEX] = playerMatrix(scaleModifier);
+    glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(matrices[PLAYER_INDEX]));
 
     //---  DRAW PLAYER 
-    GLuint vertSubIndex = glGetSubroutineIndex(shader.Program, GL_VERTEX_SHADER, "standard");
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
-    models[PLAYER_INDEX].Draw();
+    models[PLAYER_INDEX].Draw(selectLod(PLAYER_INDEX, matrices[PLAYER_INDEX]));
 }
 
-void drawBody(Shader shader, vector<GLint> locations, float scaleModifier, string subroutine) {
-    //--- CHECK SUBROUTINES
-    GLuint subroutineIndex = glGetSubroutineIndex(shader.Program, GL_FRAGMENT_SHADER, subroutine.c_str());
-    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subroutineIndex);
+void drawBody(float scaleModifier, BaseVariant variant) {
+    //--- CHECK VARIANT
+    useBase(variant);
 
     //--- SET BODY TEXTURE 
-    setTexture(PLAYER_INDEX, locations[LOCATION_REPEAT], 1.0f);
+    setMaterial(PLAYER_INDEX, 1.0f);
 
     //---  SET BODY MATRICES 
-    matrices[PLAYER_INDEX] = glm::mat4(1.0f);
-    matrices[PLAYER_INDEX] = glm::translate(matrices[PLAYER_INDEX], glm::vec3(bodyX, 0.0f, bodyZ));
-    matrices[PLAYER_INDEX] = glm::rotate(matrices[PLAYER_INDEX], glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    matrices[PLAYER_INDEX] = glm::scale(matrices[PLAYER_INDEX], glm::vec3(0.03f * scaleModifier, 0.03f * scaleModifier, 0.03f * scaleModifier));
-    glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[PLAYER_INDEX]));
+    matrices[PLAYER_INDEX] = bodyMatrix(scaleModifier);
+    glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(matrices[PLAYER_INDEX]));
 
     //---  DRAW BODY 
-    GLuint vertSubIndex = glGetSubroutineIndex(shader.Program, GL_VERTEX_SHADER, "standard");
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
-    models[PLAYER_INDEX].Draw();
+    models[PLAYER_INDEX].Draw(selectLod(PLAYER_INDEX, matrices[PLAYER_INDEX]));
 }
 
-void drawPlane(Shader shader, glm::mat4 projection, glm::mat4 view, vector<GLint> locations) {
-    setTexture(PLANE_INDEX, locations[LOCATION_REPEAT], 80.0f);
+void drawCart(float scaleModifier, BaseVariant variant) {
+    //--- CHECK VARIANT
+    useBase(variant);
 
-    //--- PASS VALUES TO SHADER 
-    glUniformMatrix4fv(locations[LOCATION_PROJECTION_MATRIX], 1, GL_FALSE, glm::value_ptr(projection));
-    glUniformMatrix4fv(locations[LOCATION_VIEW_MATRIX], 1, GL_FALSE, glm::value_ptr(view));
-    glUniform1f(locations[LOCATION_DISTORSION], distorsion);
-    glUniform1f(locations[LOCATION_TIME], glfwGetTime());
-    
-    //---  SET PLANE MATRIX
-    glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[PLANE_INDEX]));
+    //--- SET CART TEXTURE
+    setMaterial(CART_INDEX, 1.0f);
 
-    GLuint vertSubIndex = glGetSubroutineIndex(shader.Program, GL_VERTEX_SHADER, "standard");
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
+    //---  SET CART MATRICES 
+    matrices[CART_INDEX] = cartMatrix(scaleModifier);
+    glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(matrices[CART_INDEX]));
 
-    //---  DRAW PLANE 
-    models[PLANE_INDEX].Draw();
+    //---  DRAW CART 
+    models[CART_INDEX].Draw(selectLod(CART_INDEX, matrices[CART_INDEX]));
 }
 
-void drawCart(Shader shader, vector<GLint> locations, float scaleModifier, string subroutine) {
-    //--- CHECK SUBROUTINES
-    GLuint subroutineIndex = glGetSubroutineIndex(shader.Program, GL_FRAGMENT_SHADER, subroutine.c_str());
-    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subroutineIndex);
+//--- THE KEY OF A DRAW: ITS PROGRAM, ITS DISTANCE FROM THE CAMERA, ITS MATERIAL (ARRAY AND LAYER) AND ITS MODEL
+void submitDraw(BaseVariant variant, int model, glm::mat4 matrix, float repeat, int lod) {
+    float depth = glm::length(glm::vec3(matrix[3]) - lodCameraPosition);
+    uint32_t material = (materials[model].Array << 16) | materials[model].Layer;
+    renderQueue.Push(RenderQueue::Key(PASS_OPAQUE, variant, depth, RENDER_QUEUE_MAX_DEPTH, material, model), sceneDraws.size());
+    sceneDraws.push_back({ variant, model, lod, matrix, repeat, false });
+}
 
-    //--- SET CART TEXTURE
-    setTexture(CART_INDEX, locations[LOCATION_REPEAT], 1.0f);
+//--- THE TREES ARE ALL OVER THE MAP: A SINGLE ITEM, WITH THEIR OWN PROGRAM
+void submitTrees() {
+    uint32_t material = (materials[TREE_INDEX].Array << 16) | materials[TREE_INDEX].Layer;
+    renderQueue.Push(RenderQueue::Key(PASS_OPAQUE, BASE_TREES, 0.0f, RENDER_QUEUE_MAX_DEPTH, material, TREE_INDEX), sceneDraws.size());
+    sceneDraws.push_back({ BASE_TREES, TREE_INDEX, 0, glm::mat4(1.0f), 1.0f, true });
+}
 
-    //---  SET CART MATRICES 
-    matrices[CART_INDEX] = glm::mat4(1.0f);
-    matrices[CART_INDEX] = glm::translate(matrices[CART_INDEX], glm::vec3(cartX, 0.0f, cartZ));
-    matrices[CART_INDEX] = glm::scale(matrices[CART_INDEX], glm::vec3(1.25f * scaleModifier, 1.25f * scaleModifier, 1.25f * scaleModifier));
-    glUniformMatrix4fv(locations[LOCATION_MODEL_MATRIX], 1, GL_FALSE, glm::value_ptr(matrices[CART_INDEX]));
+void executeRenderQueue(Shader& impostorShader, StreamBuffer& lodStream, StreamBuffer& drawStream, bool treesCulledOnGpu) {
+    //--- STATE SET BY THE PREVIOUS DRAWS. THE MATERIAL IS A UNIFORM OF THE PROGRAM: IT'S SET AGAIN WHEN THE PROGRAM CHANGES
+    int variant = -1;
+    int material = -1;
+    float repeat = 0.0f;
+    for (const RenderItem& item : renderQueue.Sort()) {
+        const SceneDraw& draw = sceneDraws[item.Draw];
+        if (draw.Variant != variant) {
+            useBase(draw.Variant);
+            variant = draw.Variant;
+            material = -1;
+        }
+        if (draw.Model != material || draw.Repeat != repeat) {
+            setMaterial(draw.Model, draw.Repeat);
+            material = draw.Model;
+            repeat = draw.Repeat;
+        }
+        if (draw.Trees) {
+            drawTrees(impostorShader, lodStream, drawStream, treesCulledOnGpu);
+            //--- THE IMPOSTORS LEAVE THEIR PROGRAM IN USE
+            variant = -1;
+            continue;
+        }
+        glUniformMatrix4fv(baseLocation(LOCATION_MODEL_MATRIX), 1, GL_FALSE, glm::value_ptr(draw.Matrix));
+        models[draw.Model].Draw(draw.Lod);
+    }
+}
 
-    //---  DRAW CART 
-    GLuint vertSubIndex = glGetSubroutineIndex(shader.Program, GL_VERTEX_SHADER, "standard");
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &vertSubIndex);
-    models[CART_INDEX].Draw();
+void updateLodCamera(glm::mat4 projection, glm::mat4 view) {
+    lodCameraPosition = glm::vec3(glm::inverse(view)[3]);
+    //--- projection[1][1] IS 1 / tan(fovY / 2): AT DISTANCE 1 THE SCREEN HEIGHT COVERS 2 / projection[1][1] UNITS
+    lodPixelsPerUnit = projection[1][1] * screenHeight * 0.5f;
+    lodFrustum = Frustum(projection * view);
+}
+
+float pixelsPerUnit(glm::mat4 model) {
+    //--- THE SCALE OF THE MODEL CHANGES ITS SIZE ON THE SCREEN
+    float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    return pixelsPerUnit(glm::vec3(model[3]), scale);
+}
+
+//--- SAME, FOR THE INSTANCES THAT HAVE NO MATRIX
+float pixelsPerUnit(glm::vec3 position, float scale) {
+    float distance = max(glm::length(position - lodCameraPosition), 0.1f);
+    return lodPixelsPerUnit * scale / distance;
+}
+
+int selectLod(int index, glm::mat4 model) {
+    return models[index].SelectLod(pixelsPerUnit(model), LOD_PIXEL_ERROR);
+}
+
+//--- BOUNDING SPHERES OF THE TREES FOR THE CULLING: THE TREES ARE NOT ROTATED, SO THE SPHERE OF THE IMPOSTOR
+//--- (OBJECT SPACE) IS ONLY SCALED AND MOVED
+void buildTreesSpheres() {
+    treesSpheres.Clear();
+    treesSpheres.Reserve(treesInstances.size());
+    for (const Instance& tree : treesInstances) {
+        float scale = tree.Scale();
+        treesSpheres.Add(tree.Position + treeImpostor.Center * scale, treeImpostor.Radius * scale);
+    }
+}
+
+//--- SPREADS THE 16 BITS OF value ON THE EVEN BITS OF THE RESULT
+uint32_t spreadBits(uint32_t value) {
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+//--- SORTS THE TREES BY THE MORTON CODE (Z-ORDER) OF THEIR CELL: TREES CLOSE ON THE MAP ARE CLOSE IN THE ARRAYS, SO A CHUNK
+//--- OF THE CULLING IS A SMALL AREA OF THE MAP, AND THE SURVIVORS ARE WRITTEN AND READ IN LONG RUNS.
+//--- IT'S DONE ONCE AFTER LOADING: THE TREES ADDED OR REMOVED BY A RELOAD OF THE MAP ARE NOT SORTED AGAIN
+void mortonOrderTrees() {
+    vector<pair<uint32_t, uint32_t>> codes(treesInstances.size());
+    for (size_t i = 0; i < treesInstances.size(); i++) {
+        codes[i] = { spreadBits(treesCells[i].x) | (spreadBits(treesCells[i].y) << 1), (uint32_t)i };
+    }
+    sort(codes.begin(), codes.end());
+
+    vector<Instance> sortedInstances(treesInstances.size());
+    vector<glm::ivec2> sortedCells(treesCells.size());
+    for (size_t i = 0; i < codes.size(); i++) {
+        sortedInstances[i] = treesInstances[codes[i].second];
+        sortedCells[i] = treesCells[codes[i].second];
+    }
+    treesInstances.swap(sortedInstances);
+    treesCells.swap(sortedCells);
+}
+
+//--- VALUES OF THE CULLING SHADER THAT DON'T CHANGE, AND OBJECTS OF THE CULLING ON THE GPU
+void setupTreesCulling(Shader& cullShader) {
+    cullShader.Use();
+    treeImpostor.SetUniforms(cullShader);
+    glUniform1i(cullShader.Uniform("instances"), TREES_UNIT);
+    glUniform1f(cullShader.Uniform("lodPixelError"), LOD_PIXEL_ERROR);
+    glUniform1f(cullShader.Uniform("impostorPixelRadius"), IMPOSTOR_PIXEL_RADIUS);
+    const vector<float>& lodErrors = models[TREE_INDEX].LodErrors();
+    glUniform1fv(cullShader.Uniform("lodErrors"), min((int)lodErrors.size(), MAX_LODS), lodErrors.data());
+    glUniform1i(cullShader.Uniform("lodCount"), min(models[TREE_INDEX].LodCount(), MAX_LODS));
+
+    for (CullFrame& frame : cullFrames) {
+        glGenQueries(MAX_LODS + 1, frame.Queries);
+        frame.Count = 0;
+    }
+    //--- THE TREES HAVE NO VERTEX ATTRIBUTES (SEE cull.vert), THE VAO IS EMPTY
+    glGenVertexArrays(1, &cullVAO);
+}
+
+//--- ONE POINT FOR EACH TREE, WITHOUT RASTERIZATION, FOR EACH LOD (THE LAST PASS, lodCount, ARE THE IMPOSTORS):
+//--- THE VISIBLE TREES OF THE LOD ARE WRITTEN AT lod * count IN THE SET OF THIS FRAME, AND COUNTED BY ITS QUERY
+void cullTreesOnGpu(Shader& cullShader) {
+    int lodCount = models[TREE_INDEX].LodCount();
+    GLsizei count = treesInstances.size();
+    CullFrame& frame = cullFrames[cullFrame];
+    frame.Count = 0;
+    if (count == 0) {
+        return;
+    }
+    //--- A NEW STORE LOSES THE RESULTS OF THE OTHER SETS
+    if (treesCullBuffer.Reserve(CULL_FRAMES * (lodCount + 1) * count)) {
+        for (CullFrame& other : cullFrames) {
+            other.Count = 0;
+        }
+    }
+    frame.First = cullFrame * (lodCount + 1) * count;
+
+    cullShader.Use();
+    glUniform4fv(cullUniforms.FrustumPlanes, 6, glm::value_ptr(lodFrustum.Planes()[0]));
+    glUniform1f(cullUniforms.LodPixelsPerUnit, lodPixelsPerUnit);
+    GLState::Get().BindVertexArray(cullVAO);
+    GLState::Get().Enable(GL_RASTERIZER_DISCARD);
+    for (int lod = 0; lod <= lodCount; lod++) {
+        glUniform1i(cullUniforms.CullLod, lod);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, treesCullBuffer.Buffer(), (frame.First + lod * count) * sizeof(GLint), count * sizeof(GLint));
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, frame.Queries[lod]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    }
+    GLState::Get().Disable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    frame.Count = count;
+}
+
+//--- THE INDEXES WRITTEN BY cullTreesOnGpu IN THE PREVIOUS FRAME: THE NUMBER OF TREES OF EACH LOD COMES FROM ITS QUERY.
+//--- THE QUERIES ARE ONLY POLLED: IT RETURNS FALSE IF THE SET HAS NO RESULTS (FIRST FRAME, RELOADED MAP)
+//--- OR IF THE GPU HASN'T FINISHED IT YET, AND THE TREES OF THIS FRAME ARE CULLED ON THE CPU
+bool readTreesCulledOnGpu(vector<GLint>& lodFirst, vector<GLint>& lodInstances) {
+    const CullFrame& frame = cullFrames[(cullFrame + CULL_FRAMES - 1) % CULL_FRAMES];
+    GLsizei count = treesInstances.size();
+    if (frame.Count == 0 || frame.Count != count) {
+        return false;
+    }
+    for (size_t lod = 0; lod < lodFirst.size(); lod++) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.Queries[lod], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+    }
+    for (size_t lod = 0; lod < lodFirst.size(); lod++) {
+        GLuint written = 0;
+        glGetQueryObjectuiv(frame.Queries[lod], GL_QUERY_RESULT, &written);
+        lodFirst[lod] = frame.First + lod * count;
+        lodInstances[lod] = written;
+    }
+    treesCullBuffer.Bind(TREES_LOD_UNIT);
+    return true;
+}
+
+//--- CULLING ON THE CPU: THE INDEXES OF THE VISIBLE TREES, SORTED BY LOD, ARE WRITTEN IN THE STREAM BUFFER
+void cullTreesOnCpu(StreamBuffer& lodStream, vector<GLint>& lodFirst, vector<GLint>& lodInstances) {
+    //--- CULL THE TREES AND SELECT THE LOD OF THE VISIBLE ONES, -1 FOR THE CULLED ONES, lodCount FOR THE IMPOSTORS.
+    //--- THE TREES ARE SPLIT IN CHUNKS: THE WORKERS TAKE ALL THE CHUNKS BUT THE FIRST ONE, WHICH IS DONE BY THIS THREAD.
+    //--- THE JOBS ONLY READ THE INSTANCES, THE SPHERES AND THE LODS OF THE MODEL, AND WRITE THEIR OWN RANGE OF treeLods
+    int lodCount = lodFirst.size() - 1;
+    size_t count = treesInstances.size();
+    vector<int> treeLods(count);
+    auto cullChunk = [&](size_t first) {
+        size_t chunk = min((size_t)CULL_CHUNK, count - first);
+        uint8_t visible[CULL_CHUNK];
+        lodFrustum.Cull(treesSpheres, first, chunk, visible);
+        for (size_t i = first; i < first + chunk; i++) {
+            if (!visible[i - first]) {
+                treeLods[i] = -1;
+                continue;
+            }
+            float pixels = pixelsPerUnit(treesInstances[i].Position, treesInstances[i].Scale());
+            if (pixels * treeImpostor.Radius < IMPOSTOR_PIXEL_RADIUS) {
+                treeLods[i] = lodCount;
+            } else {
+                treeLods[i] = models[TREE_INDEX].SelectLod(pixels, LOD_PIXEL_ERROR);
+            }
+        }
+    };
+    vector<future<void>> jobs;
+    for (size_t first = CULL_CHUNK; first < count; first += CULL_CHUNK) {
+        jobs.push_back(workers.Enqueue([&cullChunk, first] { cullChunk(first); }));
+    }
+    if (count > 0) {
+        cullChunk(0);
+    }
+    for (future<void>& job : jobs) {
+        job.get();
+    }
+
+    //--- COUNT THE VISIBLE TREES OF EACH LOD, THE LAST GROUP (INDEX lodCount) ARE THE IMPOSTORS
+    vector<int> lodStart(lodCount + 2, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (treeLods[i] >= 0) {
+            lodStart[treeLods[i] + 1]++;
+        }
+    }
+    for (int lod = 0; lod <= lodCount; lod++) {
+        lodStart[lod + 1] += lodStart[lod];
+    }
+
+    //--- GROUP THE INDEXES OF THE VISIBLE TREES BY LOD
+    treesLodInstances.resize(lodStart[lodCount + 1]);
+    vector<int> next(lodStart.begin(), lodStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        if (treeLods[i] >= 0) {
+            treesLodInstances[next[treeLods[i]]++] = i;
+        }
+    }
+
+    //--- THE RING GROWS WITH THE MAP (RELOADING CAN ADD TREES), THE TEXTURE IS ATTACHED AGAIN TO THE NEW STORE
+    GLsizeiptr bytes = treesLodInstances.size() * sizeof(GLint);
+    if (STREAM_FRAMES * (bytes + 256) > lodStream.Size()) {
+        lodStream.Resize(2 * STREAM_FRAMES * (bytes + 256));
+        InstanceBuffer::Attach(treesLodTexture, GL_R32I, lodStream.Buffer());
+    }
+
+    //--- ONLY THE INDEXES OF THE VISIBLE TREES ARE WRITTEN. glTexBufferRange IS NOT IN GL 4.1: THE TEXTURE
+    //--- COVERS THE WHOLE RING, AND THE INDEXES OF THIS FRAME START AT ITS OFFSET
+    GLintptr offset = lodStream.Write(treesLodInstances.data(), bytes);
+    GLint frameOffset = offset / sizeof(GLint);
+
+    for (int lod = 0; lod <= lodCount; lod++) {
+        lodFirst[lod] = frameOffset + lodStart[lod];
+        lodInstances[lod] = lodStart[lod + 1] - lodStart[lod];
+    }
+    InstanceBuffer::BindTexture(treesLodTexture, TREES_LOD_UNIT);
+}
+
+void drawTrees(Shader& impostorShader, StreamBuffer& lodStream, StreamBuffer& drawStream, bool culledOnGpu) {
+    //--- FIRST INDEX AND NUMBER OF THE VISIBLE TREES OF EACH LOD, IN THE BUFFER TEXTURE BOUND TO TREES_LOD_UNIT.
+    //--- THE LAST GROUP (INDEX lodCount) ARE THE IMPOSTORS
+    int lodCount = models[TREE_INDEX].LodCount();
+    vector<GLint> lodFirst(lodCount + 1);
+    vector<GLint> lodInstances(lodCount + 1);
+    bool ready = culledOnGpu && readTreesCulledOnGpu(lodFirst, lodInstances);
+    if (!ready) {
+        cullTreesOnCpu(lodStream, lodFirst, lodInstances);
+    }
+    if (culledOnGpu) {
+        cullFrame = (cullFrame + 1) % CULL_FRAMES;
+    } else {
+        //--- THE RESULTS LEFT BY THE GPU ARE TOO OLD WHEN THE CULLING GOES BACK TO IT
+        for (CullFrame& frame : cullFrames) {
+            frame.Count = 0;
+        }
+    }
+
+    //--- ONE INDIRECT BATCH FOR EACH LOD, THE OFFSET SELECTS ITS RANGE OF INDEXES
+    for (int lod = 0; lod < lodCount; lod++) {
+        treesDraws.SetInstances(lod, lodInstances[lod]);
+    }
+    treesDraws.Write(drawStream);
+    for (int lod = 0; lod < lodCount; lod++) {
+        if (lodInstances[lod] == 0) {
+            continue;
+        }
+        glUniform1i(baseLocation(LOCATION_INSTANCE_OFFSET), lodFirst[lod]);
+        treesDraws.Submit(lod);
+    }
+
+    if (lodInstances[lodCount] == 0) {
+        return;
+    }
+
+    //--- THE IMPOSTORS USE THEIR OWN SHADER, WITH THE SAME FRAME VIEW OF THE BASE ONE
+    impostorShader.Use();
+    glUniform1i(impostorUniforms.InstanceOffset, lodFirst[lodCount]);
+    treeImpostor.Bind();
+    treeImpostor.DrawInstanced(lodInstances[lodCount]);
+
+    //--- THE NEXT DRAWS GO BACK TO THE BASE SHADER WITH useBase
+    GLState::Get().ActiveTexture(GL_TEXTURE1);
 }
 
 string vecToString(glm::vec2 vector) {
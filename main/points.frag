@@ -4,9 +4,17 @@
 layout(location = 0) out vec4 color;
 
 //--- INPUT FROM APP
-uniform sampler2D tex;
-uniform float time;
-uniform float distorsion;
+uniform sampler2DArray materials[8];
+uniform ivec2 material;
+
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
 
 //--- INPUT FROM GEOMETRY SHADER
 in vec2 tex_coord;
@@ -92,7 +100,7 @@ float snoise(vec3 v) {
 }
 
 void main() {
-    vec4 baseColor = texture(tex, tex_coord);
+    vec4 baseColor = texture(materials[material.x], vec3(tex_coord, material.y));
     if(baseColor.x < 0.1f && baseColor.y < 0.1f && baseColor.z < 0.1f) {
         discard;
     }
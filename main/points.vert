@@ -2,8 +2,14 @@
 
 layout(location = 0) in vec3 position;
 
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
+//--- PER-FRAME/PER-VIEW CONSTANTS, SHARED BY ALL THE PROGRAMS (LAYOUT CHECKED IN frame_uniforms.h)
+layout (std140) uniform Frame {
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec4 cameraPosition;
+    float time;
+    float distorsion;
+};
 
 void main()
 {